@@ -0,0 +1,458 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+/** Minimal FlatBuffers serializer for Arrow IPC metadata.
+    Objects are written front-to-back with each table directly followed by the objects it refers to, since FlatBuffers offsets are unsigned.
+    REF: https://flatbuffers.dev/internals/ */
+class FlatBufferBuilder {
+public:
+    struct Object;
+    typedef std::shared_ptr<Object> Ref;
+
+    /** Table field. Either a little-endian scalar, an offset to another object or absent. */
+    struct Field {
+        size_t   Size = 0;  ///< scalar size in bytes (0 for offset and absent fields)
+        uint64_t Value = 0;
+        Ref      Child;
+    };
+
+    struct Object {
+        enum Kind { TABLE, STRING, VECTOR, TABLE_VECTOR };
+
+        Kind                 Type = TABLE;
+        std::vector<Field>   Fields;   ///< TABLE: fields in schema declaration order
+        std::vector<uint8_t> Data;     ///< STRING & VECTOR: element bytes
+        size_t               Count = 0;
+        size_t               Align = 4;
+        std::vector<Ref>     Children; ///< TABLE_VECTOR: tables
+    };
+
+    template <class T>
+    static Field Scalar(T value) {
+        Field field;
+        field.Size = sizeof(T);
+        field.Value = static_cast<uint64_t>(value);
+        return field;
+    }
+
+    static Field Offset(Ref child) {
+        Field field;
+        field.Child = child;
+        return field;
+    }
+
+    static Field Absent() {
+        return Field();
+    }
+
+    static Ref Table(std::vector<Field> fields) {
+        auto obj = std::make_shared<Object>();
+        obj->Fields = std::move(fields);
+        return obj;
+    }
+
+    static Ref String(const std::string& str) {
+        auto obj = std::make_shared<Object>();
+        obj->Type = Object::STRING;
+        obj->Data.assign(str.begin(), str.end());
+        obj->Count = str.size();
+        return obj;
+    }
+
+    /** Vector of scalars or structs. The element bytes must already be in little-endian struct layout. */
+    static Ref Vector(std::vector<uint8_t> data, size_t count, size_t align) {
+        auto obj = std::make_shared<Object>();
+        obj->Type = Object::VECTOR;
+        obj->Data = std::move(data);
+        obj->Count = count;
+        obj->Align = align;
+        return obj;
+    }
+
+    static Ref Tables(std::vector<Ref> tables) {
+        auto obj = std::make_shared<Object>();
+        obj->Type = Object::TABLE_VECTOR;
+        obj->Children = std::move(tables);
+        return obj;
+    }
+
+    /** Serialize buffer with "root" as root table. The size is padded to a multiple of 8 bytes. */
+    static std::vector<uint8_t> Finish(const Ref& root) {
+        std::vector<uint8_t> buf(4);
+        size_t root_pos = Write(buf, *root);
+        Put(buf, 0, root_pos, 4);
+        Pad(buf, 8);
+        return buf;
+    }
+
+    static void Put(std::vector<uint8_t>& buf, size_t pos, uint64_t value, size_t size) {
+        for (size_t i = 0; i < size; ++i)
+            buf[pos + i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+
+private:
+    static void Pad(std::vector<uint8_t>& buf, size_t align) {
+        buf.resize((buf.size() + align - 1) / align * align);
+    }
+
+    /** Append object. Returns its position. */
+    static size_t Write(std::vector<uint8_t>& buf, const Object& obj) {
+        if ((obj.Type == Object::STRING) || (obj.Type == Object::VECTOR)) {
+            // elements directly follow the 32bit length and must be aligned
+            size_t align = (std::max)(obj.Align, static_cast<size_t>(4));
+            while ((buf.size() + 4) % align)
+                buf.push_back(0);
+
+            size_t pos = buf.size();
+            buf.resize(pos + 4);
+            Put(buf, pos, obj.Count, 4);
+            buf.insert(buf.end(), obj.Data.begin(), obj.Data.end());
+            if (obj.Type == Object::STRING)
+                buf.push_back(0); // zero-terminated
+            return pos;
+        }
+
+        if (obj.Type == Object::TABLE_VECTOR) {
+            Pad(buf, 4);
+            size_t pos = buf.size();
+            buf.resize(pos + 4 + 4 * obj.Children.size());
+            Put(buf, pos, obj.Children.size(), 4);
+            for (size_t i = 0; i < obj.Children.size(); ++i) {
+                size_t slot = pos + 4 + 4 * i;
+                size_t child = Write(buf, *obj.Children[i]);
+                Put(buf, slot, child - slot, 4);
+            }
+            return pos;
+        }
+
+        // table layout: 32bit vtable offset followed by the fields, largest first to avoid padding
+        const size_t count = obj.Fields.size();
+        std::vector<size_t> offsets(count, 0);
+        size_t table_size = 4, table_align = 4;
+        for (size_t size : {8, 4, 2, 1}) {
+            for (size_t i = 0; i < count; ++i) {
+                size_t field_size = obj.Fields[i].Child ? 4 : obj.Fields[i].Size;
+                if (field_size != size)
+                    continue;
+                table_size = (table_size + size - 1) / size * size;
+                offsets[i] = table_size;
+                table_size += size;
+                table_align = (std::max)(table_align, size);
+            }
+        }
+
+        // vtable with field offsets precedes the table
+        Pad(buf, 2);
+        size_t vtable_pos = buf.size();
+        buf.resize(vtable_pos + 4 + 2 * count);
+        Put(buf, vtable_pos, 4 + 2 * count, 2);
+        Put(buf, vtable_pos + 2, table_size, 2);
+        for (size_t i = 0; i < count; ++i)
+            Put(buf, vtable_pos + 4 + 2 * i, offsets[i], 2);
+
+        Pad(buf, table_align);
+        size_t table_pos = buf.size();
+        buf.resize(table_pos + table_size);
+        Put(buf, table_pos, table_pos - vtable_pos, 4);
+        for (size_t i = 0; i < count; ++i) {
+            if (obj.Fields[i].Size)
+                Put(buf, table_pos + offsets[i], obj.Fields[i].Value, obj.Fields[i].Size);
+        }
+
+        // referenced objects follow the table
+        for (size_t i = 0; i < count; ++i) {
+            if (!obj.Fields[i].Child)
+                continue;
+            size_t slot = table_pos + offsets[i];
+            size_t child = Write(buf, *obj.Fields[i].Child);
+            Put(buf, slot, child - slot, 4);
+        }
+        return table_pos;
+    }
+};
+
+
+/** Arrow IPC streaming format writer for flat tables with Int16, Int32 and dictionary-encoded UTF-8 columns. All columns are nullable.
+    Rows are buffered column-by-column and written as record batches, preceded by dictionary batches with the dictionary entries added since the previous batch.
+    Dictionaries are replaced once they exceed a size limit, so that memory usage stays bounded for large inputs.
+    REF: https://arrow.apache.org/docs/format/Columnar.html#serialization-and-interprocess-communication-ipc */
+class ArrowStreamWriter {
+public:
+    enum class ColumnType {
+        Int16,
+        Int32,
+        DictionaryUtf8, ///< int32 indices into a dictionary of UTF-8 strings
+    };
+
+    struct Field {
+        std::string Name; ///< UTF-8
+        ColumnType  Type;
+    };
+
+    ArrowStreamWriter(FILE* file, const std::vector<Field>& fields, size_t batch_rows = 64 * 1024, size_t dictionary_limit = 16 << 20) : m_file(file), m_batch_rows(batch_rows), m_dictionary_limit(dictionary_limit) {
+        for (const Field& field : fields) {
+            Column column;
+            column.Type = field.Type;
+            m_columns.push_back(std::move(column));
+        }
+        WriteSchema(fields);
+    }
+
+    void AppendNull(size_t col) {
+        Column& column = m_columns[col];
+        AppendValidity(column, false);
+        column.Values.resize(column.Values.size() + ValueSize(column.Type));
+    }
+
+    void AppendInt(size_t col, int32_t value) {
+        Column& column = m_columns[col];
+        AppendValidity(column, true);
+        size_t pos = column.Values.size();
+        column.Values.resize(pos + ValueSize(column.Type));
+        FlatBufferBuilder::Put(column.Values, pos, static_cast<uint32_t>(value), ValueSize(column.Type));
+    }
+
+    /** Append index returned by DictionaryIndex(). */
+    void AppendIndex(size_t col, int32_t index) {
+        AppendInt(col, index);
+    }
+
+    /** Get dictionary index of a UTF-8 string. Strings not already in the dictionary are added. */
+    int32_t DictionaryIndex(size_t col, const std::string& value) {
+        Column& column = m_columns[col];
+        auto it = column.Lookup.find(value);
+        if (it != column.Lookup.end())
+            return it->second;
+
+        int32_t index = static_cast<int32_t>(column.DictOffsets.size() - 1);
+        column.Lookup.emplace(value, index);
+        column.DictData += value;
+        column.DictOffsets.push_back(static_cast<int32_t>(column.DictData.size()));
+        m_dictionary_bytes += value.size();
+        return index;
+    }
+
+    /** Incremented whenever the dictionaries are replaced. Indices from a previous generation are no longer valid. */
+    uint32_t DictionaryGeneration() const {
+        return m_generation;
+    }
+
+    /** Complete the current row. Writes a record batch when the batch is full. */
+    void EndRow() {
+        m_rows++;
+        if (m_rows >= m_batch_rows)
+            Flush();
+    }
+
+    /** Write buffered rows and the end-of-stream marker. */
+    void Close() {
+        Flush();
+        const uint32_t EOS[2] = {0xFFFFFFFF, 0};
+        Write(EOS, sizeof(EOS));
+    }
+
+    uint64_t RowCount() const {
+        return m_total_rows + m_rows;
+    }
+
+private:
+    struct Column {
+        ColumnType           Type;
+        std::vector<uint8_t> Validity;  ///< LSB-first bitmap
+        size_t               NullCount = 0;
+        std::vector<uint8_t> Values;
+
+        std::unordered_map<std::string, int32_t> Lookup;
+        std::vector<int32_t> DictOffsets = {0};
+        std::string          DictData;
+        size_t               DictSent = 0;      ///< dictionary entries already written
+        bool                 DictWritten = false;
+    };
+
+    /** Message body with 8-byte aligned buffers. */
+    struct Body {
+        std::vector<uint8_t> Data;
+        std::vector<uint8_t> Buffers; ///< Buffer structs (offset, length)
+        size_t               BufferCount = 0;
+
+        void Add(const void* data, size_t size) {
+            size_t pos = Buffers.size();
+            Buffers.resize(pos + 16);
+            FlatBufferBuilder::Put(Buffers, pos, Data.size(), 8);
+            FlatBufferBuilder::Put(Buffers, pos + 8, size, 8);
+            BufferCount++;
+
+            const uint8_t* ptr = static_cast<const uint8_t*>(data);
+            Data.insert(Data.end(), ptr, ptr + size);
+            Data.resize((Data.size() + 7) / 8 * 8);
+        }
+    };
+
+    typedef FlatBufferBuilder FB;
+
+    // Schema.fbs and Message.fbs constants
+    static const uint8_t HEADER_SCHEMA = 1;
+    static const uint8_t HEADER_DICTIONARY_BATCH = 2;
+    static const uint8_t HEADER_RECORD_BATCH = 3;
+    static const uint8_t TYPE_INT = 2;
+    static const uint8_t TYPE_UTF8 = 5;
+    static const int16_t METADATA_V5 = 4;
+
+    static size_t ValueSize(ColumnType type) {
+        return (type == ColumnType::Int16) ? 2 : 4;
+    }
+
+    void AppendValidity(Column& column, bool valid) {
+        if (m_rows % 8 == 0)
+            column.Validity.push_back(0);
+        if (valid)
+            column.Validity.back() |= static_cast<uint8_t>(1 << (m_rows % 8));
+        else
+            column.NullCount++;
+    }
+
+    static FB::Ref IntType(int bit_width) {
+        return FB::Table({FB::Scalar<int32_t>(bit_width), FB::Scalar<uint8_t>(1)});
+    }
+
+    void WriteSchema(const std::vector<Field>& fields) {
+        std::vector<FB::Ref> field_tables;
+        for (size_t i = 0; i < fields.size(); ++i) {
+            bool dictionary = (fields[i].Type == ColumnType::DictionaryUtf8);
+            FB::Ref type = dictionary ? FB::Table({}) : IntType(fields[i].Type == ColumnType::Int16 ? 16 : 32);
+            FB::Field encoding = FB::Absent();
+            if (dictionary) // dictionary ID is the column index
+                encoding = FB::Offset(FB::Table({FB::Scalar<int64_t>(i), FB::Offset(IntType(32)), FB::Scalar<uint8_t>(0)}));
+
+            field_tables.push_back(FB::Table({
+                FB::Offset(FB::String(fields[i].Name)),
+                FB::Scalar<uint8_t>(1), // nullable
+                FB::Scalar<uint8_t>(dictionary ? TYPE_UTF8 : TYPE_INT),
+                FB::Offset(type),
+                encoding,
+                FB::Offset(FB::Tables({})), // children
+            }));
+        }
+
+        FB::Ref schema = FB::Table({FB::Scalar<int16_t>(0), FB::Offset(FB::Tables(field_tables))}); // little-endian
+        WriteMessage(HEADER_SCHEMA, schema, Body());
+    }
+
+    /** RecordBatch table for the given FieldNode structs (length, null_count) and body buffers. */
+    static FB::Ref RecordBatch(size_t length, std::vector<uint8_t> nodes, size_t node_count, const Body& body) {
+        return FB::Table({FB::Scalar<int64_t>(length), FB::Offset(FB::Vector(std::move(nodes), node_count, 8)), FB::Offset(FB::Vector(body.Buffers, body.BufferCount, 8))});
+    }
+
+    static void AddNode(std::vector<uint8_t>& nodes, size_t length, size_t null_count) {
+        size_t pos = nodes.size();
+        nodes.resize(pos + 16);
+        FB::Put(nodes, pos, length, 8);
+        FB::Put(nodes, pos + 8, null_count, 8);
+    }
+
+    void WriteDictionary(size_t col, bool delta) {
+        Column& column = m_columns[col];
+        size_t first = delta ? column.DictSent : 0;
+        size_t count = column.DictOffsets.size() - 1 - first;
+
+        // offsets of the new entries, rebased to start at zero
+        std::vector<uint8_t> offsets(4 * (count + 1));
+        for (size_t i = 0; i <= count; ++i)
+            FB::Put(offsets, 4 * i, column.DictOffsets[first + i] - column.DictOffsets[first], 4);
+
+        Body body;
+        body.Add(nullptr, 0); // no nulls
+        body.Add(offsets.data(), offsets.size());
+        body.Add(column.DictData.data() + column.DictOffsets[first], column.DictOffsets[first + count] - column.DictOffsets[first]);
+
+        std::vector<uint8_t> nodes;
+        AddNode(nodes, count, 0);
+        FB::Ref batch = FB::Table({FB::Scalar<int64_t>(col), FB::Offset(RecordBatch(count, std::move(nodes), 1, body)), FB::Scalar<uint8_t>(delta ? 1 : 0)});
+        WriteMessage(HEADER_DICTIONARY_BATCH, batch, body);
+
+        column.DictSent = column.DictOffsets.size() - 1;
+        column.DictWritten = true;
+    }
+
+    void Flush() {
+        if (m_rows == 0)
+            return;
+
+        // all dictionaries must be sent before the first record batch, later only new entries
+        for (size_t col = 0; col < m_columns.size(); ++col) {
+            Column& column = m_columns[col];
+            if (column.Type != ColumnType::DictionaryUtf8)
+                continue;
+            if (!column.DictWritten)
+                WriteDictionary(col, false);
+            else if (column.DictSent + 1 < column.DictOffsets.size())
+                WriteDictionary(col, true);
+        }
+
+        Body body;
+        std::vector<uint8_t> nodes;
+        for (Column& column : m_columns) {
+            AddNode(nodes, m_rows, column.NullCount);
+            if (column.NullCount)
+                body.Add(column.Validity.data(), column.Validity.size());
+            else
+                body.Add(nullptr, 0);
+            body.Add(column.Values.data(), column.Values.size());
+
+            column.Validity.clear();
+            column.Values.clear();
+            column.NullCount = 0;
+        }
+        WriteMessage(HEADER_RECORD_BATCH, RecordBatch(m_rows, std::move(nodes), m_columns.size(), body), body);
+        m_total_rows += m_rows;
+        m_rows = 0;
+
+        if (m_dictionary_bytes > m_dictionary_limit) {
+            // start over with empty dictionaries that replace the previous ones
+            for (Column& column : m_columns) {
+                column.Lookup.clear();
+                column.DictOffsets.assign(1, 0);
+                column.DictData.clear();
+                column.DictSent = 0;
+                column.DictWritten = false;
+            }
+            m_dictionary_bytes = 0;
+            m_generation++;
+        }
+    }
+
+    /** Encapsulated message: continuation marker, metadata size, Message flatbuffer and body. */
+    void WriteMessage(uint8_t header_type, const FB::Ref& header, const Body& body) {
+        FB::Ref message = FB::Table({FB::Scalar<int16_t>(METADATA_V5), FB::Scalar<uint8_t>(header_type), FB::Offset(header), FB::Scalar<int64_t>(body.Data.size())});
+        std::vector<uint8_t> metadata = FB::Finish(message);
+
+        std::vector<uint8_t> prefix(8);
+        FB::Put(prefix, 0, 0xFFFFFFFF, 4);
+        FB::Put(prefix, 4, metadata.size(), 4);
+        Write(prefix.data(), prefix.size());
+        Write(metadata.data(), metadata.size());
+        Write(body.Data.data(), body.Data.size());
+    }
+
+    void Write(const void* data, size_t size) {
+        if (size && (fwrite(data, 1, size, m_file) != size))
+            throw std::runtime_error("Unable to write Arrow stream");
+    }
+
+    FILE*               m_file = nullptr;
+    size_t              m_batch_rows = 0;
+    size_t              m_dictionary_limit = 0;
+    std::vector<Column> m_columns;
+    size_t              m_rows = 0;       ///< rows in current batch
+    uint64_t            m_total_rows = 0; ///< rows already written
+    size_t              m_dictionary_bytes = 0;
+    uint32_t            m_generation = 0;
+};
@@ -0,0 +1,342 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+/** Forward-only reader of Compound File Binary (OLE structured storage) files from non-seekable input like pipes.
+    The header, FAT, directory and mini FAT are resolved first, after which only sectors of the requested streams are kept.
+    Sectors encountered before their purpose is known are cached speculatively up to a memory budget.
+    REF: https://learn.microsoft.com/en-us/openspecs/windows_protocols/ms-cfb/ */
+class CfbStreamReader {
+public:
+    CfbStreamReader(FILE* input, size_t cache_budget) : m_input(input), m_budget(cache_budget) {
+        uint8_t header[512] = {};
+        ReadInput(header, sizeof(header));
+
+        static const uint8_t SIGNATURE[8] = {0xD0, 0xCF, 0x11, 0xE0, 0xA1, 0xB1, 0x1A, 0xE1};
+        if (memcmp(header, SIGNATURE, sizeof(SIGNATURE)) != 0)
+            throw std::runtime_error("Not a Compound File Binary (MSI) file");
+
+        m_major_version = Read16(header + 0x1A);
+        uint16_t sector_shift = Read16(header + 0x1E);
+        uint16_t mini_sector_shift = Read16(header + 0x20);
+        if (!(((m_major_version == 3) && (sector_shift == 9)) || ((m_major_version == 4) && (sector_shift == 12))) || (mini_sector_shift != 6))
+            throw std::runtime_error("Unsupported Compound File Binary version");
+        m_sector_size = 1u << sector_shift;
+
+        m_fat_sector_count = Read32(header + 0x2C);
+        m_first_dir_sector = Read32(header + 0x30);
+        m_mini_cutoff = Read32(header + 0x38);
+        m_first_minifat_sector = Read32(header + 0x3C);
+        m_first_difat_sector = Read32(header + 0x44);
+        for (size_t i = 0; i < 109; ++i) {
+            uint32_t sector = Read32(header + 0x4C + 4 * i);
+            if (sector <= MAXREGSECT)
+                m_fat_sectors.push_back(sector);
+        }
+
+        // version 4 header occupies a full 4096 byte sector
+        std::vector<uint8_t> padding(m_sector_size - sizeof(header));
+        ReadInput(padding.data(), padding.size());
+    }
+
+    /** Read streams with the given (already encoded) names from the root storage in a single forward pass. Streams not found are omitted from the result. */
+    std::map<std::u16string, std::vector<uint8_t>> ReadStreams(const std::vector<std::u16string>& names) {
+        return ReadStreams([&names](const std::u16string& name) {
+            return std::find(names.begin(), names.end(), name) != names.end();
+        });
+    }
+
+    /** Read all streams in the root storage where filter(encoded_name) returns true in a single forward pass. */
+    template <class Filter>
+    std::map<std::u16string, std::vector<uint8_t>> ReadStreams(Filter filter) {
+        LoadFat();
+        LoadDirectory();
+        LoadMiniFat();
+
+        // locate requested streams and the sectors they occupy
+        std::vector<const DirEntry*> streams;
+        for (const DirEntry& entry : m_directory) {
+            if ((entry.Type == STREAM) && entry.InRoot && filter(entry.Name))
+                streams.push_back(&entry);
+        }
+
+        std::vector<uint32_t> mini_stream = Chain(m_directory.at(0).StartSector);
+        std::vector<bool> needed;
+        auto mark = [&needed](uint32_t sector) {
+            if (sector >= needed.size())
+                needed.resize(sector + 1);
+            needed[sector] = true;
+        };
+        for (const DirEntry* entry : streams) {
+            if (entry->Size < m_mini_cutoff) {
+                for (uint32_t mini : MiniChain(entry->StartSector))
+                    mark(MiniStreamSector(mini_stream, mini));
+            } else {
+                for (uint32_t sector : Chain(entry->StartSector))
+                    mark(sector);
+            }
+        }
+        SetNeeded(needed);
+
+        std::map<std::u16string, std::vector<uint8_t>> result;
+        for (const DirEntry* entry : streams) {
+            std::vector<uint8_t>& data = result[entry->Name];
+            data.reserve(static_cast<size_t>(entry->Size));
+            if (entry->Size < m_mini_cutoff) {
+                for (uint32_t mini : MiniChain(entry->StartSector)) {
+                    const uint8_t* sector = Sector(MiniStreamSector(mini_stream, mini));
+                    size_t offset = (static_cast<size_t>(mini) * MINI_SECTOR_SIZE) % m_sector_size;
+                    size_t len = std::min<size_t>(static_cast<size_t>(MINI_SECTOR_SIZE), static_cast<size_t>(entry->Size) - data.size());
+                    data.insert(data.end(), sector + offset, sector + offset + len);
+                }
+            } else {
+                for (uint32_t sector_idx : Chain(entry->StartSector)) {
+                    const uint8_t* sector = Sector(sector_idx);
+                    size_t len = std::min<size_t>(m_sector_size, static_cast<size_t>(entry->Size) - data.size());
+                    data.insert(data.end(), sector, sector + len);
+                    Release(sector_idx);
+                }
+            }
+            if (data.size() != entry->Size)
+                throw std::runtime_error("Truncated Compound File Binary stream");
+        }
+        return result;
+    }
+
+private:
+    static const uint32_t MAXREGSECT = 0xFFFFFFFA;
+    static const uint32_t ENDOFCHAIN = 0xFFFFFFFE;
+    static const uint32_t NOSTREAM = 0xFFFFFFFF;
+    static const size_t   MINI_SECTOR_SIZE = 64;
+
+    enum EntryType : uint8_t {
+        STORAGE = 1,
+        STREAM = 2,
+        ROOT = 5,
+    };
+
+    struct DirEntry {
+        std::u16string Name;
+        uint8_t        Type = 0;
+        uint32_t       Left = NOSTREAM;
+        uint32_t       Right = NOSTREAM;
+        uint32_t       Child = NOSTREAM;
+        uint32_t       StartSector = ENDOFCHAIN;
+        uint64_t       Size = 0;
+        bool           InRoot = false; ///< direct child of the root storage
+    };
+
+    void LoadFat() {
+        // remaining FAT sector locations are listed in the DIFAT sector chain
+        uint32_t difat = m_first_difat_sector;
+        for (size_t count = 0; (difat <= MAXREGSECT) && (m_fat_sectors.size() < m_fat_sector_count); ++count) {
+            if (count > m_fat_sector_count)
+                throw std::runtime_error("Invalid DIFAT chain");
+            const uint8_t* sector = Sector(difat);
+            const size_t ids = m_sector_size / 4 - 1;
+            for (size_t i = 0; i < ids; ++i) {
+                uint32_t fat_sector = Read32(sector + 4 * i);
+                if (fat_sector <= MAXREGSECT)
+                    m_fat_sectors.push_back(fat_sector);
+            }
+            uint32_t next = Read32(sector + 4 * ids);
+            Release(difat);
+            difat = next;
+        }
+        if (m_fat_sectors.size() < m_fat_sector_count)
+            throw std::runtime_error("Incomplete FAT");
+        m_fat_sectors.resize(m_fat_sector_count);
+
+        m_fat.resize(m_fat_sectors.size() * (m_sector_size / 4));
+        for (size_t s = 0; s < m_fat_sectors.size(); ++s) {
+            const uint8_t* sector = Sector(m_fat_sectors[s]);
+            for (size_t i = 0; i < m_sector_size / 4; ++i)
+                m_fat[s * (m_sector_size / 4) + i] = Read32(sector + 4 * i);
+            Release(m_fat_sectors[s]);
+        }
+    }
+
+    void LoadDirectory() {
+        for (uint32_t sector_idx : Chain(m_first_dir_sector)) {
+            const uint8_t* sector = Sector(sector_idx);
+            for (size_t offset = 0; offset < m_sector_size; offset += 128) {
+                const uint8_t* raw = sector + offset;
+                DirEntry entry;
+                uint16_t name_len = std::min<uint16_t>(Read16(raw + 64), 64);
+                for (size_t i = 0; i + 1 < name_len / 2u; ++i)
+                    entry.Name += static_cast<char16_t>(Read16(raw + 2 * i)); // exclude null-termination
+                entry.Type = raw[66];
+                entry.Left = Read32(raw + 68);
+                entry.Right = Read32(raw + 72);
+                entry.Child = Read32(raw + 76);
+                entry.StartSector = Read32(raw + 116);
+                entry.Size = Read32(raw + 120);
+                if (m_major_version == 4)
+                    entry.Size |= static_cast<uint64_t>(Read32(raw + 124)) << 32; // high part undefined in version 3
+                m_directory.push_back(entry);
+            }
+            Release(sector_idx);
+        }
+        if (m_directory.empty() || (m_directory[0].Type != ROOT))
+            throw std::runtime_error("Missing root storage");
+
+        // mark direct children of root by walking the sibling tree
+        std::vector<uint32_t> pending = {m_directory[0].Child};
+        size_t visited = 0;
+        while (!pending.empty()) {
+            uint32_t idx = pending.back();
+            pending.pop_back();
+            if (idx >= m_directory.size())
+                continue;
+            if ((++visited > m_directory.size()) || m_directory[idx].InRoot)
+                throw std::runtime_error("Invalid directory tree");
+
+            m_directory[idx].InRoot = true;
+            pending.push_back(m_directory[idx].Left);
+            pending.push_back(m_directory[idx].Right);
+        }
+    }
+
+    void LoadMiniFat() {
+        for (uint32_t sector_idx : Chain(m_first_minifat_sector)) {
+            const uint8_t* sector = Sector(sector_idx);
+            for (size_t i = 0; i < m_sector_size / 4; ++i)
+                m_minifat.push_back(Read32(sector + 4 * i));
+            Release(sector_idx);
+        }
+    }
+
+    /** Follow a FAT chain. */
+    std::vector<uint32_t> Chain(uint32_t start) const {
+        std::vector<uint32_t> result;
+        for (uint32_t sector = start; sector != ENDOFCHAIN; sector = m_fat[sector]) {
+            if ((sector >= m_fat.size()) || (result.size() >= m_fat.size()))
+                throw std::runtime_error("Invalid FAT chain");
+            result.push_back(sector);
+        }
+        return result;
+    }
+
+    /** Follow a mini FAT chain. */
+    std::vector<uint32_t> MiniChain(uint32_t start) const {
+        std::vector<uint32_t> result;
+        for (uint32_t mini = start; mini != ENDOFCHAIN; mini = m_minifat[mini]) {
+            if ((mini >= m_minifat.size()) || (result.size() >= m_minifat.size()))
+                throw std::runtime_error("Invalid mini FAT chain");
+            result.push_back(mini);
+        }
+        return result;
+    }
+
+    /** Regular sector that contains a given mini sector. */
+    uint32_t MiniStreamSector(const std::vector<uint32_t>& mini_stream, uint32_t mini) const {
+        size_t idx = static_cast<size_t>(mini) * MINI_SECTOR_SIZE / m_sector_size;
+        if (idx >= mini_stream.size())
+            throw std::runtime_error("Mini sector outside mini stream");
+        return mini_stream[idx];
+    }
+
+    /** Restrict caching to the given sectors, and drop cached sectors that are no longer needed. */
+    void SetNeeded(const std::vector<bool>& needed) {
+        m_needed = needed;
+        m_needed_known = true;
+        for (auto it = m_cache.begin(); it != m_cache.end();) {
+            if (!IsNeeded(it->first)) {
+                m_cached_bytes -= it->second.size();
+                it = m_cache.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    bool IsNeeded(uint32_t sector) const {
+        if (!m_needed_known)
+            return true; // purpose not yet known
+        return (sector < m_needed.size()) && m_needed[sector];
+    }
+
+    /** Get sector contents, reading forward from the input as needed. */
+    const uint8_t* Sector(uint32_t idx) {
+        auto it = m_cache.find(idx);
+        if (it != m_cache.end())
+            return it->second.data();
+
+        if (idx < m_next_sector) {
+            std::string msg = "MSI data in sector " + std::to_string(idx) + " lies behind already consumed input";
+            if (m_evicted_bytes)
+                msg += " (" + std::to_string(m_evicted_bytes >> 20) + " MB discarded after exceeding the " + std::to_string(m_budget >> 20) + " MB streaming cache)";
+            throw std::runtime_error(msg + ". Save the package to a file and pass the file path instead.");
+        }
+
+        while (m_next_sector <= idx) {
+            std::vector<uint8_t> buffer(m_sector_size);
+            ReadInput(buffer.data(), buffer.size());
+            uint32_t current = m_next_sector++;
+            if ((current != idx) && !IsNeeded(current))
+                continue; // skip payload data
+
+            if (!m_needed_known && (m_cached_bytes + m_sector_size > m_budget)) {
+                // speculative cache full: discard everything of unknown purpose
+                m_evicted_bytes += m_cached_bytes;
+                m_cached_bytes = 0;
+                m_cache.clear();
+            }
+            m_cached_bytes += m_sector_size;
+            m_cache[current] = std::move(buffer);
+        }
+        return m_cache[idx].data();
+    }
+
+    /** Drop sector from cache after use. */
+    void Release(uint32_t idx) {
+        auto it = m_cache.find(idx);
+        if (it == m_cache.end())
+            return;
+        m_cached_bytes -= it->second.size();
+        m_cache.erase(it);
+    }
+
+    void ReadInput(uint8_t* buffer, size_t size) {
+        if (fread(buffer, 1, size, m_input) != size)
+            throw std::runtime_error("Unexpected end of Compound File Binary input");
+    }
+
+    static uint16_t Read16(const uint8_t* ptr) {
+        return static_cast<uint16_t>(ptr[0] | (ptr[1] << 8));
+    }
+
+    static uint32_t Read32(const uint8_t* ptr) {
+        return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | (static_cast<uint32_t>(ptr[3]) << 24);
+    }
+
+    FILE*    m_input = nullptr;
+    size_t   m_budget = 0;
+    uint16_t m_major_version = 0;
+    uint32_t m_sector_size = 0;
+    uint32_t m_fat_sector_count = 0;
+    uint32_t m_first_dir_sector = ENDOFCHAIN;
+    uint32_t m_mini_cutoff = 4096;
+    uint32_t m_first_minifat_sector = ENDOFCHAIN;
+    uint32_t m_first_difat_sector = ENDOFCHAIN;
+
+    std::vector<uint32_t> m_fat_sectors;
+    std::vector<uint32_t> m_fat;
+    std::vector<uint32_t> m_minifat;
+    std::vector<DirEntry> m_directory;
+
+    uint32_t                                            m_next_sector = 0;   ///< next sector to read from input
+    std::unordered_map<uint32_t, std::vector<uint8_t>> m_cache;             ///< sectors read but not yet consumed
+    size_t                                              m_cached_bytes = 0;
+    size_t                                              m_evicted_bytes = 0;
+    std::vector<bool>                                   m_needed;            ///< sectors of requested streams
+    bool                                                m_needed_known = false;
+};
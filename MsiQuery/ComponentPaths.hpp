@@ -0,0 +1,108 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "Guid.hpp"
+#include "MsiTables.hpp"
+#include "RegistryHive.hpp"
+
+
+/** Installed key paths of components, indexed by (ProductCode, ComponentId).
+    Built either from an offline SOFTWARE hive in a single scan, or from per-component MsiGetComponentPath calls on the running system.
+    Key paths are either file/folder paths like "C:\Program Files\App\app.exe" or registry paths like "02:\SOFTWARE\App\Name".
+    REF: https://learn.microsoft.com/en-us/windows/win32/api/msi/nf-msi-msigetcomponentpathw */
+class ComponentPathIndex {
+public:
+    /** Decoded registry key path. */
+    struct RegistryKeyPath {
+        RegEntry::RootType Root = RegEntry::LocalMachine;
+        bool               Is64Bit = false;
+        std::wstring       Key;    ///< key and value name, without root
+    };
+
+    /** Scan "Microsoft\Windows\CurrentVersion\Installer\UserData\<SID>\Components\<packed ComponentId>" keys of a SOFTWARE hive.
+        Each component key has one value per client product, named by the packed ProductCode. */
+    static ComponentPathIndex FromHive(const RegistryHive& hive) {
+        uint32_t user_data = hive.Subkey(hive.Root(), L"Microsoft\\Windows\\CurrentVersion\\Installer\\UserData");
+        if (!user_data)
+            throw std::runtime_error("Installer\\UserData key not found in registry hive");
+
+        ComponentPathIndex index;
+        hive.ForEachSubkey(user_data, [&](uint32_t sid) {
+            uint32_t components = hive.Subkey(sid, L"Components");
+            if (!components)
+                return;
+
+            hive.ForEachSubkey(components, [&](uint32_t component) {
+                Guid component_id;
+                if (!Guid::TryParsePacked(hive.KeyName(component), component_id))
+                    return; // not a component key
+
+                hive.ForEachValue(component, [&](uint32_t value) {
+                    Guid product_code; // null for permanent components
+                    if (!Guid::TryParsePacked(hive.ValueName(value), product_code))
+                        return;
+                    index.Add(product_code, component_id, hive.ValueString(value)); // machine SID "S-1-5-18" is visited before user SIDs
+                });
+            });
+        });
+        return index;
+    }
+
+    /** Register key path. Existing entries are kept. An empty key path indicates that the component is not installed. */
+    void Add(const Guid& product_code, const Guid& component_id, std::wstring key_path) {
+        m_paths.emplace(Key{product_code, component_id}, std::move(key_path));
+        m_products.insert(product_code);
+    }
+
+    /** Returns false if no components are registered for the product, i.e. the product is not installed. */
+    bool HasProduct(const Guid& product_code) const {
+        return m_products.count(product_code) > 0;
+    }
+
+    /** Returns nullptr if the component is not registered for the product. */
+    const std::wstring* Find(const Guid& product_code, const Guid& component_id) const {
+        auto it = m_paths.find(Key{product_code, component_id});
+        if (it == m_paths.end())
+            return nullptr;
+        return &it->second;
+    }
+
+    size_t Size() const {
+        return m_paths.size();
+    }
+
+    /** Decode "NN:\key" registry key path. The second digit is the root (0=HKCR, 1=HKCU, 2=HKLM, 3=HKU) and a first digit of 2 or more denotes the 64-bit registry view.
+        Returns false for file & folder paths. */
+    static bool TryParseRegistryKeyPath(const std::wstring& key_path, RegistryKeyPath& result) {
+        if ((key_path.size() < 3) || (key_path[2] != L':'))
+            return false;
+        if ((key_path[0] < L'0') || (key_path[0] > L'9') || (key_path[1] < L'0') || (key_path[1] > L'3'))
+            return false;
+
+        result.Root = static_cast<RegEntry::RootType>(key_path[1] - L'0');
+        result.Is64Bit = key_path[0] >= L'2';
+        result.Key = key_path.substr((key_path.size() > 3) && (key_path[3] == L'\\') ? 4 : 3);
+        return true;
+    }
+
+private:
+    struct Key {
+        Guid ProductCode;
+        Guid ComponentId;
+
+        bool operator == (const Key& other) const {
+            return (ProductCode == other.ProductCode) && (ComponentId == other.ComponentId);
+        }
+    };
+
+    struct KeyHasher {
+        size_t operator () (const Key& key) const {
+            Guid::Hasher hasher;
+            return hasher(key.ComponentId) ^ (hasher(key.ProductCode) * 31);
+        }
+    };
+
+    std::unordered_map<Key, std::wstring, KeyHasher> m_paths;
+    std::unordered_set<Guid, Guid::Hasher>           m_products;
+};
@@ -0,0 +1,293 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <Windows.h>
+#include <bcrypt.h>
+#include <fcntl.h>
+#include <fdi.h>
+
+#pragma comment(lib, "Bcrypt.lib")
+#pragma comment(lib, "Cabinet.lib")
+
+
+/** 128bit MD5 file hash. Same layout as MSIFILEHASHINFO and the MsiFileHash table, so that both sources can be compared directly. */
+struct FileHash {
+    uint32_t Part[4] = {};
+
+    bool operator == (const FileHash& other) const {
+        return memcmp(Part, other.Part, sizeof(Part)) == 0;
+    }
+
+    std::wstring ToString() const {
+        wchar_t buffer[33] = {};
+        swprintf_s(buffer, L"%08X%08X%08X%08X", Part[0], Part[1], Part[2], Part[3]);
+        return buffer;
+    }
+
+    struct Hasher {
+        size_t operator () (const FileHash& hash) const {
+            // MD5 output is already uniformly distributed
+            return (static_cast<size_t>(hash.Part[0]) << 32) ^ hash.Part[1];
+        }
+    };
+};
+
+
+/** Incremental MD5 hashing through the Windows CNG API. */
+class Md5Hasher {
+public:
+    Md5Hasher() {
+        if (BCryptCreateHash(Provider(), &m_hash, nullptr, 0, nullptr, 0, 0) != 0)
+            throw std::runtime_error("BCryptCreateHash failed");
+    }
+
+    ~Md5Hasher() {
+        BCryptDestroyHash(m_hash);
+    }
+
+    Md5Hasher(const Md5Hasher&) = delete;
+    Md5Hasher& operator = (const Md5Hasher&) = delete;
+
+    void Update(const void* data, size_t size) {
+        if (BCryptHashData(m_hash, static_cast<UCHAR*>(const_cast<void*>(data)), static_cast<ULONG>(size), 0) != 0)
+            throw std::runtime_error("BCryptHashData failed");
+    }
+
+    FileHash Finish() {
+        FileHash hash;
+        if (BCryptFinishHash(m_hash, reinterpret_cast<UCHAR*>(hash.Part), sizeof(hash.Part), 0) != 0)
+            throw std::runtime_error("BCryptFinishHash failed");
+        return hash;
+    }
+
+private:
+    /** Algorithm provider shared by all threads. */
+    static BCRYPT_ALG_HANDLE Provider() {
+        static BCRYPT_ALG_HANDLE provider = []() {
+            BCRYPT_ALG_HANDLE alg = nullptr;
+            if (BCryptOpenAlgorithmProvider(&alg, BCRYPT_MD5_ALGORITHM, nullptr, 0) != 0)
+                throw std::runtime_error("BCryptOpenAlgorithmProvider failed");
+            return alg;
+        }();
+        return provider;
+    }
+
+    BCRYPT_HASH_HANDLE m_hash = nullptr;
+};
+
+
+/** Memory limit shared by threads that buffer cabinets. A single allocation is always granted if nothing else is held, so that oversized cabinets cannot deadlock. */
+class MemoryBudget {
+public:
+    /** RAII reservation that is returned to the budget on destruction. */
+    class Lease {
+    public:
+        Lease(MemoryBudget& budget) : m_budget(budget) {
+        }
+
+        ~Lease() {
+            Release();
+        }
+
+        Lease(const Lease&) = delete;
+        Lease& operator = (const Lease&) = delete;
+
+        /** Block until "size" bytes are available. Replaces any earlier reservation. */
+        void Acquire(size_t size) {
+            Release();
+            std::unique_lock<std::mutex> lock(m_budget.m_mutex);
+            m_budget.m_cond.wait(lock, [&]() { return (m_budget.m_used == 0) || (m_budget.m_used + size <= m_budget.m_limit); });
+            m_budget.m_used += size;
+            m_size = size;
+        }
+
+        void Release() {
+            if (!m_size)
+                return;
+
+            {
+                std::lock_guard<std::mutex> lock(m_budget.m_mutex);
+                m_budget.m_used -= m_size;
+                m_size = 0;
+            }
+            m_budget.m_cond.notify_all();
+        }
+
+    private:
+        MemoryBudget& m_budget;
+        size_t        m_size = 0;
+    };
+
+    MemoryBudget(size_t limit) : m_limit(limit) {
+    }
+
+private:
+    std::mutex              m_mutex;
+    std::condition_variable m_cond;
+    const size_t            m_limit;
+    size_t                  m_used = 0;
+};
+
+
+/** Decompress an in-memory cabinet through the FDI API and hash the requested files without writing them to disk.
+    Based on the "Using FDI" sample with memory-backed file callbacks.
+    REF: https://learn.microsoft.com/en-us/windows/win32/api/fdi/ */
+class CabinetHasher {
+public:
+    /** Returns MD5 hashes of all files in "names" that are found in the cabinet. */
+    static std::unordered_map<std::string, FileHash> Hash(const std::vector<char>& cabinet, const std::unordered_set<std::string>& names) {
+        Context ctx = {&names, {}, {}};
+
+        ERF erf = {};
+        HFDI fdi = FDICreate(Alloc, Free, Open, Read, Write, Close, Seek, cpuUNKNOWN, &erf);
+        if (!fdi)
+            throw std::runtime_error("FDICreate failed");
+
+        // pass buffer address as "filename" to the Open callback
+        char cab_name[32] = {};
+        sprintf_s(cab_name, "%p", static_cast<const void*>(&cabinet));
+        char cab_path[] = "";
+
+        BOOL ok = FDICopy(fdi, cab_name, cab_path, 0, Notify, nullptr, &ctx);
+        FDIDestroy(fdi);
+        if (!ctx.error.empty())
+            throw std::runtime_error(ctx.error); // exceptions cannot propagate through the FDI callbacks
+        if (!ok)
+            throw std::runtime_error("FDICopy failed");
+
+        return ctx.results;
+    }
+
+private:
+    struct Context {
+        const std::unordered_set<std::string>*    names;
+        std::unordered_map<std::string, FileHash> results;
+        std::string                               error; ///< first exception caught in a callback
+    };
+
+    /** Handle returned from Open or fdintCOPY_FILE. */
+    struct Handle {
+        bool                       is_source = false;
+        const std::vector<char>*   source = nullptr; ///< cabinet buffer (only if is_source)
+        size_t                     pos = 0;
+        Context*                   ctx = nullptr;    ///< only if !is_source
+        std::string                name;             ///< file name in cabinet (only if !is_source)
+        std::unique_ptr<Md5Hasher> hasher;           ///< only if !is_source
+    };
+
+    static FNALLOC(Alloc) {
+        return malloc(cb);
+    }
+
+    static FNFREE(Free) {
+        free(pv);
+    }
+
+    static FNOPEN(Open) {
+        auto* handle = new (std::nothrow) Handle();
+        if (!handle)
+            return -1;
+        handle->is_source = true;
+        handle->source = reinterpret_cast<const std::vector<char>*>(static_cast<uintptr_t>(strtoull(pszFile, nullptr, 16)));
+        handle->pos = 0;
+        return reinterpret_cast<INT_PTR>(handle);
+    }
+
+    static FNREAD(Read) {
+        auto* handle = reinterpret_cast<Handle*>(hf);
+        if (!handle->is_source)
+            return static_cast<UINT>(-1);
+
+        size_t len = std::min<size_t>(cb, handle->source->size() - handle->pos);
+        memcpy(pv, handle->source->data() + handle->pos, len);
+        handle->pos += len;
+        return static_cast<UINT>(len);
+    }
+
+    static FNWRITE(Write) {
+        auto* handle = reinterpret_cast<Handle*>(hf);
+        if (handle->is_source)
+            return static_cast<UINT>(-1);
+
+        try {
+            handle->hasher->Update(pv, cb);
+        } catch (const std::exception& err) {
+            handle->ctx->error = err.what();
+            return static_cast<UINT>(-1); // abort extraction
+        }
+        return cb;
+    }
+
+    static FNCLOSE(Close) {
+        delete reinterpret_cast<Handle*>(hf);
+        return 0;
+    }
+
+    static FNSEEK(Seek) {
+        auto* handle = reinterpret_cast<Handle*>(hf);
+        if (!handle->is_source)
+            return -1;
+
+        long base = 0;
+        if (seektype == SEEK_CUR)
+            base = static_cast<long>(handle->pos);
+        else if (seektype == SEEK_END)
+            base = static_cast<long>(handle->source->size());
+
+        long pos = base + dist;
+        if ((pos < 0) || (static_cast<size_t>(pos) > handle->source->size()))
+            return -1;
+
+        handle->pos = pos;
+        return pos;
+    }
+
+    static FNFDINOTIFY(Notify) {
+        auto* ctx = static_cast<Context*>(pfdin->pv);
+        switch (fdint) {
+        case fdintCOPY_FILE:
+            {
+                // file names in MSI cabinets are File table keys
+                if (!ctx->names->count(pfdin->psz1))
+                    return 0; // skip file
+
+                try {
+                    std::unique_ptr<Handle> handle(new Handle());
+                    handle->ctx = ctx;
+                    handle->name = pfdin->psz1;
+                    handle->hasher.reset(new Md5Hasher());
+                    return reinterpret_cast<INT_PTR>(handle.release());
+                } catch (const std::exception& err) {
+                    ctx->error = err.what();
+                    return -1; // abort extraction
+                }
+            }
+        case fdintCLOSE_FILE_INFO:
+            {
+                std::unique_ptr<Handle> handle(reinterpret_cast<Handle*>(pfdin->hf));
+                try {
+                    ctx->results[handle->name] = handle->hasher->Finish();
+                } catch (const std::exception& err) {
+                    ctx->error = err.what();
+                    return FALSE; // abort extraction
+                }
+                return TRUE;
+            }
+        case fdintNEXT_CABINET:
+            return -1; // cabinets spanning multiple streams not supported
+        default:
+            return 0;
+        }
+    }
+};
@@ -0,0 +1,375 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cwctype>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Guid.hpp"
+#include "MappedFile.hpp"
+
+
+/** Key categories stored in a fleet index. */
+enum class IndexKind : uint32_t {
+    File      = 0, ///< long file name from the File table
+    Component = 1, ///< ComponentId GUID from the Component table, stored as 16 raw bytes
+    Registry  = 2, ///< "Root\Key" path from the Registry table
+};
+
+static const uint32_t INDEX_KIND_COUNT = 3;
+
+
+/** Encode ComponentId as 8 code units with two GUID bytes each, so that code unit order matches GUID order. */
+inline std::wstring EncodeIndexGuid(const Guid& guid) {
+    std::wstring key(8, L'\0');
+    for (size_t i = 0; i < 8; ++i)
+        key[i] = static_cast<wchar_t>((guid.Bytes[2 * i] << 8) | guid.Bytes[2 * i + 1]);
+    return key;
+}
+
+/** Normalize a key so that lookups become case-insensitive.
+    ComponentId keys are converted to their binary form, and malformed GUIDs become an empty key that matches nothing.
+    Registry keys also accept the common hive aliases (HKLM, HKEY_LOCAL_MACHINE etc.) as root. */
+inline std::wstring NormalizeIndexKey(IndexKind kind, std::wstring key) {
+    if (kind == IndexKind::Component) {
+        Guid guid;
+        if (!Guid::TryParse(key, guid))
+            return L"";
+        return EncodeIndexGuid(guid);
+    }
+
+    std::transform(key.begin(), key.end(), key.begin(), [](wchar_t c) { return static_cast<wchar_t>(std::towlower(c)); });
+    if (kind == IndexKind::Registry) {
+        static const wchar_t* ALIASES[][2] = {
+            {L"hkcr", L"classesroot"}, {L"hkey_classes_root", L"classesroot"},
+            {L"hkcu", L"currentuser"}, {L"hkey_current_user", L"currentuser"},
+            {L"hklm", L"localmachine"}, {L"hkey_local_machine", L"localmachine"},
+            {L"hku", L"users"}, {L"hkey_users", L"users"},
+        };
+        size_t sep = key.find(L'\\');
+        std::wstring root = key.substr(0, sep);
+        for (auto& alias : ALIASES) {
+            if (root == alias[0]) {
+                key = alias[1] + key.substr(root.size());
+                break;
+            }
+        }
+
+        while (!key.empty() && (key.back() == L'\\'))
+            key.pop_back();
+    }
+    return key;
+}
+
+
+/** On-disk layout of a fleet index. All integers are little-endian and all offsets are relative to the start of the file.
+    Strings are stored as UTF-16 code units in a shared string blob. ComponentId keys occupy 8 code units (see EncodeIndexGuid). */
+namespace FleetIndexFormat {
+    static const char     MAGIC[8] = {'M', 'S', 'I', 'Q', 'I', 'D', 'X', '1'};
+    static const uint32_t VERSION = 2; ///< 2: binary ComponentId keys
+
+    struct Header {
+        char     Magic[8];
+        uint32_t Version;
+        uint32_t PackageCount;
+        uint32_t TermCount;
+        uint32_t PostingCount;
+        uint64_t PackageOffset; ///< PackageRecord[PackageCount]
+        uint64_t TermOffset;    ///< TermRecord[TermCount] sorted by (Kind, Key)
+        uint64_t PostingOffset; ///< uint32_t[PostingCount] package indices
+        uint64_t StringOffset;  ///< uint16_t[] string blob
+        uint64_t StringCount;   ///< string blob length in code units
+    };
+    static_assert(sizeof(Header) == 64, "FleetIndexFormat::Header size mismatch");
+
+    struct PackageRecord {
+        uint32_t NameOffset; ///< index into string blob
+        uint32_t NameLength;
+    };
+
+    struct TermRecord {
+        uint32_t Kind;
+        uint32_t KeyOffset;    ///< index into string blob
+        uint32_t KeyLength;
+        uint32_t PostingBegin; ///< index into posting list array
+        uint32_t PostingCount;
+    };
+}
+
+
+/** Read-only view of an on-disk fleet index. The file is memory-mapped, so opening is cheap and lookups only touch the pages of the binary search path. */
+class FleetIndexReader {
+public:
+    explicit FleetIndexReader(const std::wstring& path) : m_file(path) {
+        using namespace FleetIndexFormat;
+        if (m_file.Size() < sizeof(Header))
+            throw std::runtime_error("Fleet index file truncated");
+
+        m_header = reinterpret_cast<const Header*>(m_file.Data());
+        if ((memcmp(m_header->Magic, MAGIC, sizeof(MAGIC)) != 0) || (m_header->Version != VERSION))
+            throw std::runtime_error("Not a fleet index file");
+
+        // validate section bounds before any access
+        if (!InBounds(m_header->PackageOffset, m_header->PackageCount, sizeof(PackageRecord))
+            || !InBounds(m_header->TermOffset, m_header->TermCount, sizeof(TermRecord))
+            || !InBounds(m_header->PostingOffset, m_header->PostingCount, sizeof(uint32_t))
+            || !InBounds(m_header->StringOffset, m_header->StringCount, sizeof(uint16_t)))
+            throw std::runtime_error("Fleet index file corrupt");
+
+        m_packages = reinterpret_cast<const PackageRecord*>(m_file.Data() + m_header->PackageOffset);
+        m_terms = reinterpret_cast<const TermRecord*>(m_file.Data() + m_header->TermOffset);
+        m_postings = reinterpret_cast<const uint32_t*>(m_file.Data() + m_header->PostingOffset);
+        m_strings = reinterpret_cast<const uint16_t*>(m_file.Data() + m_header->StringOffset);
+    }
+
+    uint32_t PackageCount() const {
+        return m_header->PackageCount;
+    }
+
+    std::wstring PackageName(uint32_t idx) const {
+        if (idx >= m_header->PackageCount)
+            throw std::runtime_error("Fleet index package out of range");
+        return String(m_packages[idx].NameOffset, m_packages[idx].NameLength);
+    }
+
+    /** Returns indices of all packages that contain the given key. */
+    std::vector<uint32_t> Lookup(IndexKind kind, const std::wstring& key) const {
+        const std::wstring norm_key = NormalizeIndexKey(kind, key);
+
+        // binary search on (Kind, Key)
+        const FleetIndexFormat::TermRecord* begin = m_terms;
+        const FleetIndexFormat::TermRecord* end = m_terms + m_header->TermCount;
+        auto it = std::lower_bound(begin, end, 0, [&](const FleetIndexFormat::TermRecord& term, int) {
+            return Compare(term, static_cast<uint32_t>(kind), norm_key) < 0;
+        });
+        if ((it == end) || (Compare(*it, static_cast<uint32_t>(kind), norm_key) != 0))
+            return {};
+
+        return Postings(*it);
+    }
+
+    /** Invoke callback(kind, key, packages) for all terms. Used for incremental index updates. */
+    template <class Callback>
+    void ForEachTerm(Callback callback) const {
+        for (uint32_t i = 0; i < m_header->TermCount; ++i) {
+            const FleetIndexFormat::TermRecord& term = m_terms[i];
+            CheckTerm(term);
+            if (term.Kind >= INDEX_KIND_COUNT)
+                throw std::runtime_error("Fleet index file corrupt");
+            callback(static_cast<IndexKind>(term.Kind), String(term.KeyOffset, term.KeyLength), Postings(term));
+        }
+    }
+
+private:
+    bool InBounds(uint64_t offset, uint64_t count, size_t elm_size) const {
+        return (offset <= m_file.Size()) && (count <= (m_file.Size() - offset) / elm_size);
+    }
+
+    /** Validate key and posting ranges of a term. Only done for terms that are actually accessed, so that opening and lookups stay independent of the index size.
+        Sort order is not validated, since the builder always writes sorted terms and a corrupt order can only cause missed lookups. */
+    void CheckTerm(const FleetIndexFormat::TermRecord& term) const {
+        if ((term.KeyOffset > m_header->StringCount) || (term.KeyLength > m_header->StringCount - term.KeyOffset)
+            || (term.PostingBegin > m_header->PostingCount) || (term.PostingCount > m_header->PostingCount - term.PostingBegin))
+            throw std::runtime_error("Fleet index file corrupt");
+    }
+
+    std::vector<uint32_t> Postings(const FleetIndexFormat::TermRecord& term) const {
+        return std::vector<uint32_t>(m_postings + term.PostingBegin, m_postings + term.PostingBegin + term.PostingCount);
+    }
+
+    std::wstring String(uint32_t offset, uint32_t length) const {
+        if ((offset > m_header->StringCount) || (length > m_header->StringCount - offset))
+            throw std::runtime_error("Fleet index string out of range");
+        return std::wstring(m_strings + offset, m_strings + offset + length);
+    }
+
+    /** Three-way comparison of a term against (kind, key). */
+    int Compare(const FleetIndexFormat::TermRecord& term, uint32_t kind, const std::wstring& key) const {
+        if (term.Kind != kind)
+            return (term.Kind < kind) ? -1 : 1;
+
+        CheckTerm(term);
+        const uint16_t* str = m_strings + term.KeyOffset;
+        size_t len = std::min<size_t>(term.KeyLength, key.size());
+        for (size_t i = 0; i < len; ++i) {
+            uint16_t c = static_cast<uint16_t>(key[i]);
+            if (str[i] != c)
+                return (str[i] < c) ? -1 : 1;
+        }
+        if (term.KeyLength == key.size())
+            return 0;
+        return (term.KeyLength < key.size()) ? -1 : 1;
+    }
+
+    MappedFile                              m_file;
+    const FleetIndexFormat::Header*         m_header = nullptr;
+    const FleetIndexFormat::PackageRecord*  m_packages = nullptr;
+    const FleetIndexFormat::TermRecord*     m_terms = nullptr;
+    const uint32_t*                         m_postings = nullptr;
+    const uint16_t*                         m_strings = nullptr;
+};
+
+
+/** Accumulates (kind, key) -> package postings in memory and writes them as a sorted on-disk index.
+    Incremental updates are done by loading an existing index, adding packages and writing a new file. */
+class FleetIndexBuilder {
+public:
+    FleetIndexBuilder() = default;
+
+    /** Import all packages and terms from an existing index. */
+    void Load(const FleetIndexReader& index) {
+        std::vector<uint32_t> id_map(index.PackageCount());
+        for (uint32_t i = 0; i < index.PackageCount(); ++i)
+            id_map[i] = AddPackage(index.PackageName(i));
+
+        index.ForEachTerm([&](IndexKind kind, const std::wstring& key, const std::vector<uint32_t>& packages) {
+            std::vector<uint32_t>& postings = m_terms[static_cast<uint32_t>(kind)][key];
+            for (uint32_t pkg : packages)
+                postings.push_back(id_map.at(pkg));
+        });
+    }
+
+    /** Register a package and return its index. Re-adding an already indexed package drops its previous terms. */
+    uint32_t AddPackage(const std::wstring& name) {
+        auto it = m_package_ids.find(name);
+        if (it != m_package_ids.end()) {
+            uint32_t id = it->second;
+            for (auto& terms : m_terms) {
+                for (auto& term : terms) {
+                    std::vector<uint32_t>& postings = term.second;
+                    postings.erase(std::remove(postings.begin(), postings.end(), id), postings.end());
+                }
+            }
+            return id;
+        }
+
+        uint32_t id = static_cast<uint32_t>(m_packages.size());
+        m_packages.push_back(name);
+        m_package_ids[name] = id;
+        return id;
+    }
+
+    void AddTerm(IndexKind kind, const std::wstring& key, uint32_t package) {
+        AddNormalizedTerm(kind, NormalizeIndexKey(kind, key), package);
+    }
+
+    void AddComponent(const Guid& component_id, uint32_t package) {
+        AddNormalizedTerm(IndexKind::Component, EncodeIndexGuid(component_id), package);
+    }
+
+    size_t PackageCount() const {
+        return m_packages.size();
+    }
+
+    /** Write index to disk. The file is first written to a temporary file and then renamed, so that readers never see a partial index. */
+    void Write(const std::wstring& path) const {
+        using namespace FleetIndexFormat;
+
+        struct Term {
+            uint32_t                     Kind;
+            const std::wstring*          Key;
+            const std::vector<uint32_t>* Postings;
+
+            bool operator < (const Term& other) const {
+                if (Kind != other.Kind)
+                    return Kind < other.Kind;
+                return std::lexicographical_compare(Key->begin(), Key->end(), other.Key->begin(), other.Key->end(), [](wchar_t a, wchar_t b) {
+                    return static_cast<uint16_t>(a) < static_cast<uint16_t>(b);
+                });
+            }
+        };
+
+        std::vector<Term> terms;
+        for (uint32_t kind = 0; kind < INDEX_KIND_COUNT; ++kind) {
+            for (auto& term : m_terms[kind]) {
+                if (!term.second.empty())
+                    terms.push_back({kind, &term.first, &term.second});
+            }
+        }
+        std::sort(terms.begin(), terms.end());
+
+        std::vector<uint16_t>      strings;
+        std::vector<PackageRecord> package_records;
+        std::vector<TermRecord>    term_records;
+        std::vector<uint32_t>      postings;
+
+        auto add_string = [&strings](const std::wstring& str) {
+            uint32_t offset = static_cast<uint32_t>(strings.size());
+            for (wchar_t c : str)
+                strings.push_back(static_cast<uint16_t>(c));
+            return offset;
+        };
+
+        for (const std::wstring& name : m_packages)
+            package_records.push_back({add_string(name), static_cast<uint32_t>(name.size())});
+
+        for (const Term& term : terms) {
+            std::vector<uint32_t> sorted = *term.Postings;
+            std::sort(sorted.begin(), sorted.end());
+            sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+            term_records.push_back({term.Kind, add_string(*term.Key), static_cast<uint32_t>(term.Key->size()), static_cast<uint32_t>(postings.size()), static_cast<uint32_t>(sorted.size())});
+            postings.insert(postings.end(), sorted.begin(), sorted.end());
+        }
+
+        Header header = {};
+        memcpy(header.Magic, MAGIC, sizeof(MAGIC));
+        header.Version = VERSION;
+        header.PackageCount = static_cast<uint32_t>(package_records.size());
+        header.TermCount = static_cast<uint32_t>(term_records.size());
+        header.PostingCount = static_cast<uint32_t>(postings.size());
+        header.PackageOffset = sizeof(Header);
+        header.TermOffset = header.PackageOffset + Align8(package_records.size() * sizeof(PackageRecord));
+        header.PostingOffset = header.TermOffset + Align8(term_records.size() * sizeof(TermRecord));
+        header.StringOffset = header.PostingOffset + Align8(postings.size() * sizeof(uint32_t));
+        header.StringCount = strings.size();
+
+        const std::wstring tmp_path = path + L".tmp";
+        FILE* file = OpenFile(tmp_path, L"wb");
+        if (!file)
+            throw std::runtime_error("Unable to create fleet index file");
+
+        bool ok = WriteSection(file, &header, sizeof(header))
+            && WriteSection(file, package_records.data(), package_records.size() * sizeof(PackageRecord))
+            && WriteSection(file, term_records.data(), term_records.size() * sizeof(TermRecord))
+            && WriteSection(file, postings.data(), postings.size() * sizeof(uint32_t))
+            && WriteSection(file, strings.data(), strings.size() * sizeof(uint16_t));
+        ok &= (fclose(file) == 0);
+        if (!ok)
+            throw std::runtime_error("Unable to write fleet index file");
+
+        ReplaceFile(tmp_path, path);
+    }
+
+private:
+    void AddNormalizedTerm(IndexKind kind, const std::wstring& key, uint32_t package) {
+        if (key.empty())
+            return;
+
+        std::vector<uint32_t>& postings = m_terms[static_cast<uint32_t>(kind)][key];
+        if (postings.empty() || (postings.back() != package))
+            postings.push_back(package);
+    }
+
+    static uint64_t Align8(uint64_t size) {
+        return (size + 7) & ~uint64_t(7);
+    }
+
+    /** Write data followed by zero-padding to 8 byte alignment. */
+    static bool WriteSection(FILE* file, const void* data, size_t size) {
+        static const char PADDING[8] = {};
+        if (size && (fwrite(data, 1, size, file) != size))
+            return false;
+
+        size_t pad = static_cast<size_t>(Align8(size) - size);
+        return fwrite(PADDING, 1, pad, file) == pad;
+    }
+
+    std::vector<std::wstring>                                      m_packages;
+    std::unordered_map<std::wstring, uint32_t>                     m_package_ids;
+    std::unordered_map<std::wstring, std::vector<uint32_t>>        m_terms[INDEX_KIND_COUNT];
+};
@@ -0,0 +1,210 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define GUID_USE_SSE2
+#endif
+
+
+/** 128bit GUID used for ProductCode, UpgradeCode, PackageCode and ComponentId values.
+    Bytes are stored in textual order, so that ordering matches case-insensitive comparison of the "{XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}" registry format.
+    REF: https://learn.microsoft.com/en-us/windows/win32/msi/guid */
+struct Guid {
+    uint8_t Bytes[16] = {};
+
+    /** Parse "{XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}" string. Hex digits are case-insensitive. Returns false and leaves result unchanged if malformed. */
+    static bool TryParse(const std::wstring& str, Guid& result) {
+        if ((str.size() != 38) || (str[0] != L'{') || (str[9] != L'-') || (str[14] != L'-') || (str[19] != L'-') || (str[24] != L'-') || (str[37] != L'}'))
+            return false;
+
+        // gather the 32 hex digits
+        wchar_t hex[32];
+        memcpy(hex + 0, &str[1], 8 * sizeof(wchar_t));
+        memcpy(hex + 8, &str[10], 4 * sizeof(wchar_t));
+        memcpy(hex + 12, &str[15], 4 * sizeof(wchar_t));
+        memcpy(hex + 16, &str[20], 4 * sizeof(wchar_t));
+        memcpy(hex + 20, &str[25], 12 * sizeof(wchar_t));
+        Guid guid;
+        if (!DecodeHex(hex, guid.Bytes))
+            return false; // leave result untouched
+
+        result = guid;
+        return true;
+    }
+
+    /** Parse "{XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}" string. Throws on malformed input. */
+    static Guid Parse(const std::wstring& str) {
+        Guid result;
+        if (!TryParse(str, result))
+            throw std::runtime_error("Invalid GUID");
+        return result;
+    }
+
+    /** Parse 32-character "packed" GUID used as registry key name under "Installer\UserData" and "Installer\Products". Returns false if malformed. */
+    static bool TryParsePacked(const std::wstring& str, Guid& result) {
+        if (str.size() != 32)
+            return false;
+
+        wchar_t hex[32];
+        memcpy(hex, str.data(), sizeof(hex));
+        Guid packed;
+        if (!DecodeHex(hex, packed.Bytes))
+            return false;
+
+        result = packed.Repack();
+        return true;
+    }
+
+    /** Format as "{XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}" with uppercase hex digits. */
+    std::wstring ToString() const {
+        wchar_t hex[32];
+        EncodeHex(Bytes, hex);
+
+        std::wstring result(38, L'\0');
+        result[0] = L'{';
+        memcpy(&result[1], hex + 0, 8 * sizeof(wchar_t));
+        result[9] = L'-';
+        memcpy(&result[10], hex + 8, 4 * sizeof(wchar_t));
+        result[14] = L'-';
+        memcpy(&result[15], hex + 12, 4 * sizeof(wchar_t));
+        result[19] = L'-';
+        memcpy(&result[20], hex + 16, 4 * sizeof(wchar_t));
+        result[24] = L'-';
+        memcpy(&result[25], hex + 20, 12 * sizeof(wchar_t));
+        result[37] = L'}';
+        return result;
+    }
+
+    /** Format as 32-character "packed" GUID. */
+    std::wstring ToPackedString() const {
+        wchar_t hex[32];
+        EncodeHex(Repack().Bytes, hex);
+        return std::wstring(hex, 32);
+    }
+
+    bool IsNull() const {
+        static const Guid null;
+        return *this == null;
+    }
+
+    bool operator == (const Guid& other) const {
+        return memcmp(Bytes, other.Bytes, sizeof(Bytes)) == 0;
+    }
+
+    bool operator != (const Guid& other) const {
+        return !(*this == other);
+    }
+
+    bool operator < (const Guid& other) const {
+        return memcmp(Bytes, other.Bytes, sizeof(Bytes)) < 0;
+    }
+
+    struct Hasher {
+        size_t operator () (const Guid& guid) const {
+            uint64_t lo = 0, hi = 0;
+            memcpy(&lo, guid.Bytes, 8);
+            memcpy(&hi, guid.Bytes + 8, 8);
+            // GUIDs are mostly random, but sequential GUIDs only differ in a few bytes so mix both halves
+            uint64_t hash = (lo ^ (hi * 0x9E3779B97F4A7C15ull));
+            hash ^= hash >> 29;
+            return static_cast<size_t>(hash);
+        }
+    };
+
+private:
+    /** Conversion between textual and packed byte order. The packed form reverses the hex digits of the first three groups and swaps the digits within each of the remaining bytes. The operation is its own inverse. */
+    Guid Repack() const {
+        static const uint8_t ORDER[16] = {3, 2, 1, 0, 5, 4, 7, 6, 8, 9, 10, 11, 12, 13, 14, 15};
+
+        Guid result;
+        for (size_t i = 0; i < 16; ++i) {
+            uint8_t b = Bytes[ORDER[i]];
+            result.Bytes[i] = static_cast<uint8_t>((b << 4) | (b >> 4));
+        }
+        return result;
+    }
+
+    /** Decode 32 hex digits into 16 bytes. Returns false on non-hex characters. */
+    static bool DecodeHex(const wchar_t hex[32], uint8_t bytes[16]) {
+#ifdef GUID_USE_SSE2
+        // narrow to 8bit with saturation, so that non-ASCII characters become 0xFF and fail validation
+        uint16_t chars[32];
+        for (size_t i = 0; i < 32; ++i)
+            chars[i] = static_cast<uint16_t>(((sizeof(wchar_t) > 2) && (static_cast<uint32_t>(hex[i]) > 0xFFFF)) ? 0xFFFF : hex[i]);
+        const __m128i* src = reinterpret_cast<const __m128i*>(chars);
+
+        uint16_t nibble_pairs[16];
+        for (size_t half = 0; half < 2; ++half) {
+            __m128i c = _mm_packus_epi16(_mm_loadu_si128(src + 2 * half), _mm_loadu_si128(src + 2 * half + 1));
+
+            // '0'-'9' map to [0,9] and 'a'-'f'/'A'-'F' map to [0,5] in signed comparisons
+            __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+            __m128i alpha = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+            __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(digit, _mm_set1_epi8(-1)), _mm_cmplt_epi8(digit, _mm_set1_epi8(10)));
+            __m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(alpha, _mm_set1_epi8(-1)), _mm_cmplt_epi8(alpha, _mm_set1_epi8(6)));
+            if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) != 0xFFFF)
+                return false;
+
+            __m128i value = _mm_or_si128(_mm_and_si128(is_digit, digit), _mm_and_si128(is_alpha, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+            // combine pairs of nibbles: (first << 4) | second
+            __m128i first = _mm_slli_epi16(_mm_and_si128(value, _mm_set1_epi16(0x00FF)), 4);
+            __m128i second = _mm_srli_epi16(value, 8);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(nibble_pairs + 8 * half), _mm_or_si128(first, second));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes), _mm_packus_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(nibble_pairs)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(nibble_pairs + 8))));
+        return true;
+#else
+        for (size_t i = 0; i < 16; ++i) {
+            int hi = HexValue(hex[2 * i]);
+            int lo = HexValue(hex[2 * i + 1]);
+            if ((hi < 0) || (lo < 0))
+                return false;
+            bytes[i] = static_cast<uint8_t>((hi << 4) | lo);
+        }
+        return true;
+#endif
+    }
+
+    /** Encode 16 bytes as 32 uppercase hex digits. */
+    static void EncodeHex(const uint8_t bytes[16], wchar_t hex[32]) {
+#ifdef GUID_USE_SSE2
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+        __m128i mask = _mm_set1_epi8(0x0F);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(b, 4), mask);
+        __m128i lo = _mm_and_si128(b, mask);
+
+        uint8_t chars[32];
+        __m128i nibbles[2] = {_mm_unpacklo_epi8(hi, lo), _mm_unpackhi_epi8(hi, lo)};
+        for (size_t half = 0; half < 2; ++half) {
+            // '0' + n, plus 7 more for 'A'-'F'
+            __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(nibbles[half], _mm_set1_epi8(9)), _mm_set1_epi8(7));
+            __m128i ascii = _mm_add_epi8(_mm_add_epi8(nibbles[half], _mm_set1_epi8('0')), letter);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(chars + 16 * half), ascii);
+        }
+        for (size_t i = 0; i < 32; ++i)
+            hex[i] = chars[i];
+#else
+        static const char DIGITS[] = "0123456789ABCDEF";
+        for (size_t i = 0; i < 16; ++i) {
+            hex[2 * i] = DIGITS[bytes[i] >> 4];
+            hex[2 * i + 1] = DIGITS[bytes[i] & 0x0F];
+        }
+#endif
+    }
+
+#ifndef GUID_USE_SSE2
+    static int HexValue(wchar_t c) {
+        if ((c >= L'0') && (c <= L'9'))
+            return c - L'0';
+        if ((c >= L'A') && (c <= L'F'))
+            return c - L'A' + 10;
+        if ((c >= L'a') && (c <= L'f'))
+            return c - L'a' + 10;
+        return -1;
+    }
+#endif
+};
@@ -1,20 +1,24 @@
 #include "MsiQuery.hpp"
+#include "MsiStreamQuery.hpp"
+#include "MsiExport.hpp"
+#include "ComponentPaths.hpp"
+#include "FileHash.hpp"
+#include "FleetIndex.hpp"
+#include "MsiFormatted.hpp"
+#include "MsixManifest.hpp"
+#include "PackageWatch.hpp"
 #include "MsiUtil.hpp"
+#include "MsiValidate.hpp"
 #include <fcntl.h>
 #include <io.h>
+#include <atomic>
 #include <cctype>
 #include <iostream>
+#include <thread>
 
 #pragma comment(lib, "Msi.lib")
 
 
-static std::wstring ToAbsolutePath(std::wstring path) {
-    DWORD len = GetFullPathNameW(path.c_str(), 0, nullptr, nullptr);
-    std::wstring buffer(len-1, L'\0'); // subtract null-termination
-    len = GetFullPathNameW(path.c_str(), len, const_cast<wchar_t*>(buffer.data()), nullptr);
-    return buffer;
-}
-
 static std::wstring ToString(INSTALLSTATE state) {
     switch (state) {
     case INSTALLSTATE_NOTUSED: return L"NOTUSED";
@@ -36,8 +40,30 @@ static std::wstring ToString(INSTALLSTATE state) {
     }
 }
 
-void AnalyzeMsiFile(std::wstring msi_file, std::wstring * product_code) {
-    MsiQuery query(msi_file);
+/** Print features, custom actions, binaries and registry entries. Works with both MsiQuery and MsiStreamQuery.
+    Feature states are queried if product_code is set. Installed paths are resolved through component_paths, which is looked up with the ProductCode property if product_code is not set.
+    Authored paths are shown for packages whose ProductCode is missing or has no components in component_paths. */
+template <class Query>
+void AnalyzeMsiTables(Query& query, const Guid * product_code, const ComponentPathIndex * component_paths = nullptr) {
+    FileTable files = query.QueryFile();
+    ComponentTable components = query.QueryComponent();
+    DirectoryTable directories = query.QueryDirectory();
+    PropertyTable properties = query.QueryProperty();
+
+    Guid installed_product;
+    if (product_code) {
+        installed_product = *product_code;
+    } else if (component_paths) {
+        const std::wstring* code = properties.Find(L"ProductCode");
+        if (code)
+            Guid::TryParse(*code, installed_product);
+
+        // checked once per package, so that authored paths are not mistaken for installed state
+        if (installed_product.IsNull() || !component_paths->HasProduct(installed_product)) {
+            std::wcout << L"ProductCode " << (code ? *code : L"<missing>") << L" not installed in image. Showing authored paths.\n\n";
+            component_paths = nullptr;
+        }
+    }
 
     {
         std::wcout << L"Features:\n";
@@ -45,7 +71,7 @@ void AnalyzeMsiFile(std::wstring msi_file, std::wstring * product_code) {
         for (const FeatureEntry& feature : features) {
             std::wstring install_state;
             if (product_code) {
-                INSTALLSTATE state = MsiQueryFeatureStateW(product_code->c_str(), feature.Feature.c_str());
+                INSTALLSTATE state = MsiQueryFeatureStateW(product_code->ToString().c_str(), feature.Feature.c_str());
                 install_state = L", INSTALLSTATE=" + ToString(state);
             }
 
@@ -54,7 +80,15 @@ void AnalyzeMsiFile(std::wstring msi_file, std::wstring * product_code) {
         std::wcout << L'\n';
     }
 
-    FileTable files = query.QueryFile();
+    // installed key path of a component, or nullptr if unknown
+    auto find_key_path = [&](const ComponentTable::Entry& component) -> const std::wstring* {
+        if (!component_paths || component.ComponentId.IsNull())
+            return nullptr;
+        return component_paths->Find(installed_product, component.ComponentId);
+    };
+
+    // expands [Property], [#File] etc. in Formatted columns
+    FormattedExpander formatter(properties, directories, files, components);
 
     {
         std::wcout << L"Custom actions: (might affect system state)\n";
@@ -68,7 +102,7 @@ void AnalyzeMsiFile(std::wstring msi_file, std::wstring * product_code) {
 
             has_custom_action = true;
             FileTable::Entry file = files.Lookup(ca.Source, false); // might fail
-            std::wcout << L"  " << ca.Action << L": "  << ca.Type.ToString() << L' ' << file.LongFileName() << L' ' << ca.Target << L'\n';
+            std::wcout << L"  " << ca.Action << L": "  << ca.Type.ToString() << L' ' << file.LongFileName() << L' ' << formatter.Format(ca.Target) << L'\n';
         }
         if (!has_custom_action)
             std::wcout << L"  <none>\n";
@@ -76,8 +110,6 @@ void AnalyzeMsiFile(std::wstring msi_file, std::wstring * product_code) {
         std::wcout << L"\n";
     }
 
-    ComponentTable components = query.QueryComponent();
-
     {
         std::wcout << L"Installed binaries: (skipping other file types)\n";
 
@@ -88,17 +120,19 @@ void AnalyzeMsiFile(std::wstring msi_file, std::wstring * product_code) {
             return str;
         };
 
-        DirectoryTable directories = query.QueryDirectory();
-
         std::vector<std::wstring> exe_files, dll_files;
         for (const FileTable::Entry& file : files.Entries()) {
             ComponentTable::Entry component = components.Lookup(file.Component_);
 
-            std::wstring path;
-            if (product_code)
-                path = GetComponentPath(*product_code, component.ComponentId); // get actually installed paths
-            else
-                path = directories.Lookup(component.Directory_) + L'\\' + file.LongFileName();
+            std::wstring path = directories.Lookup(component.Directory_) + L'\\' + file.LongFileName();
+            if (const std::wstring* key_path = find_key_path(component)) {
+                // get actually installed paths. All files of a component share the folder of its key path
+                ComponentPathIndex::RegistryKeyPath reg_path;
+                if (key_path->empty())
+                    path.clear(); // not installed
+                else if (!ComponentPathIndex::TryParseRegistryKeyPath(*key_path, reg_path))
+                    path = key_path->substr(0, key_path->rfind(L'\\') + 1) + file.LongFileName();
+            }
 
             if (to_lowercase(path).find(L".exe") != path.npos)
                 exe_files.push_back(path);
@@ -121,12 +155,19 @@ void AnalyzeMsiFile(std::wstring msi_file, std::wstring * product_code) {
         std::wcout << L"Registry entries:\n";
 
         auto reg_entries = query.QueryRegistry();
-        for (const RegEntry& reg : reg_entries) {
-            std::wstring path;
-            if (product_code && false) // disabled for now since it always return "E:\"
-                path = GetComponentPath(*product_code, components.Lookup(reg.Component_).ComponentId);
-            else
-                path = reg.RootStr() + L'\\' + reg.Key +  L'\\' + reg.Name + L'=' + reg.Value;
+        for (RegEntry reg : reg_entries) {
+            const ComponentTable::Entry* component = component_paths ? components.Find(reg.Component_) : nullptr; // dangling Component_ skips path resolution
+            if (const std::wstring* key_path = component ? find_key_path(*component) : nullptr) {
+                if (key_path->empty())
+                    continue; // not installed
+
+                // per-user or per-machine root of installed component
+                ComponentPathIndex::RegistryKeyPath reg_path;
+                if ((reg.Root == RegEntry::Dynamic) && ComponentPathIndex::TryParseRegistryKeyPath(*key_path, reg_path))
+                    reg.Root = reg_path.Root;
+            }
+
+            std::wstring path = reg.RootStr() + L'\\' + formatter.Format(reg.Key) +  L'\\' + formatter.Format(reg.Name) + L'=' + formatter.Format(reg.Value);
 
             std::wcout << L"  " << path << L'\n';
         }
@@ -137,21 +178,487 @@ void AnalyzeMsiFile(std::wstring msi_file, std::wstring * product_code) {
     }
 }
 
-bool IsGUID (const std::wstring & str) {
-    if (str.length() == 38) {
-        if ((str[0] == L'{') && (str.back() == L'}'))
-            return true;
+void AnalyzeMsiFile(std::wstring msi_file, const Guid * product_code) {
+    MsiQuery query(msi_file);
+    if (!product_code) {
+        AnalyzeMsiTables(query, nullptr);
+        return;
+    }
+
+    // one MsiGetComponentPath lookup per component instead of per file
+    ComponentPathIndex component_paths;
+    for (const ComponentTable::Entry& component : query.QueryComponent().Entries()) {
+        if (component.ComponentId.IsNull())
+            continue;
+
+        std::wstring key_path;
+        try {
+            key_path = GetComponentPath(*product_code, component.ComponentId);
+        } catch (const std::exception&) {
+            // INSTALLSTATE_ABSENT
+        }
+        component_paths.Add(*product_code, component.ComponentId, key_path);
+    }
+    AnalyzeMsiTables(query, product_code, &component_paths);
+}
+
+/** Offline analysis of MSI files with installed paths resolved from a SOFTWARE registry hive of a Windows image, like "D:\Windows\System32\config\SOFTWARE".
+    The hive is scanned once, after which all lookups are hash lookups. Packages are parsed with MsiStreamQuery, so msi.dll is not used. */
+void AnalyzeMsiFilesWithHive (const std::wstring& hive_file, const std::vector<std::wstring>& inputs) {
+    ComponentPathIndex component_paths;
+    {
+        MappedFile file(hive_file);
+        component_paths = ComponentPathIndex::FromHive(RegistryHive(file.Data(), file.Size()));
+    }
+    std::wcout << L"Installed component key paths: " << component_paths.Size() << L"\n\n";
+
+    for (const std::wstring& input : inputs) {
+        for (const std::wstring& msi_file : FindMsiFiles(input)) {
+            std::wcout << L"Analyzing " << msi_file << L"...\n";
+            FILE* input = OpenFile(msi_file, L"rb");
+            if (!input) {
+                std::wcout << L"ERROR: Unable to open file\n\n";
+                continue;
+            }
+
+            try {
+                MsiStreamQuery query(input);
+                AnalyzeMsiTables(query, nullptr, &component_paths);
+            } catch (const std::exception& err) {
+                std::wcout << L"ERROR: " << ToUnicode(err.what()) << L"\n\n";
+            }
+            fclose(input);
+        }
+    }
+}
+
+/** Offline analysis of MSI file piped to stdin, like "unzip -p archive.zip setup.msi | MsiQuery.exe -".
+    The input is parsed in a single forward pass, so no temporary file is needed. */
+void AnalyzeMsiStream () {
+    _setmode(_fileno(stdin), _O_BINARY);
+    MsiStreamQuery query(stdin);
+
+    PropertyTable properties = query.QueryProperty();
+    const std::wstring* product_code = properties.Find(L"ProductCode"); // REQUIRED
+    if (!product_code)
+        throw std::runtime_error("ProductCode property missing");
+    const std::wstring* upgrade_str = properties.Find(L"UpgradeCode"); // optional
+    Guid upgrade_code; // null if absent or malformed
+    if (upgrade_str)
+        Guid::TryParse(*upgrade_str, upgrade_code);
+    std::wcout << L"MSI properties:\n";
+    std::wcout << L"  ProductCode: " << Guid::Parse(*product_code).ToString() << L"\n";
+    std::wcout << L"  UpgradeCode: " << (upgrade_code.IsNull() ? (upgrade_str ? *upgrade_str : L"") : upgrade_code.ToString()) << L"\n"; // malformed values printed as-is
+    std::wcout << L"\n";
+    std::wcout << L"Reading from standard input. Will perform offline analysis.\n\n";
+
+    AnalyzeMsiTables(query, nullptr);
+}
+
+/** Add File, Component & Registry keys of a MSI file to a fleet index. */
+void IndexMsiFile (FleetIndexBuilder& index, const std::wstring& msi_file) {
+    MsiQuery query(msi_file);
+    FileTable files = query.QueryFile();
+    ComponentTable components = query.QueryComponent();
+    DirectoryTable directories = query.QueryDirectory();
+    PropertyTable properties = query.QueryProperty();
+    FormattedExpander formatter(properties, directories, files, components);
+
+    uint32_t package = index.AddPackage(msi_file);
+
+    for (const FileTable::Entry& file : files.Entries())
+        index.AddTerm(IndexKind::File, file.LongFileName(), package);
+
+    for (const ComponentTable::Entry& component : components.Entries()) {
+        if (!component.ComponentId.IsNull())
+            index.AddComponent(component.ComponentId, package);
+    }
+
+    for (const RegEntry& reg : query.QueryRegistry())
+        index.AddTerm(IndexKind::Registry, reg.RootStr() + L'\\' + formatter.Format(reg.Key), package);
+}
+
+
+/** Create or incrementally update a fleet index with MSI files from the given files or folders. */
+void BuildFleetIndex (const std::wstring& index_file, const std::vector<std::wstring>& inputs) {
+    FleetIndexBuilder index;
+    if (GetFileAttributesW(index_file.c_str()) != INVALID_FILE_ATTRIBUTES) {
+        FleetIndexReader existing(index_file); // closed before the index is rewritten
+        index.Load(existing);
+        std::wcout << L"Loaded index with " << existing.PackageCount() << L" packages.\n";
+    }
+
+    size_t indexed = 0;
+    for (const std::wstring& input : inputs) {
+        for (const std::wstring& msi_file : FindMsiFiles(input)) {
+            try {
+                IndexMsiFile(index, msi_file);
+                ++indexed;
+            } catch (const std::exception& err) {
+                std::wcout << L"  ERROR: " << msi_file << L": " << ToUnicode(err.what()) << L'\n';
+            }
+        }
+    }
+
+    index.Write(index_file);
+    std::wcout << L"Indexed " << indexed << L" packages. Index now contains " << index.PackageCount() << L" packages.\n";
+}
+
+
+/** List all packages in a fleet index that contain a given file name, ComponentId or registry key. */
+void LookupFleetIndex (const std::wstring& index_file, const std::wstring& kind_str, const std::wstring& key) {
+    IndexKind kind;
+    if (kind_str == L"file")
+        kind = IndexKind::File;
+    else if (kind_str == L"component")
+        kind = IndexKind::Component;
+    else if (kind_str == L"registry")
+        kind = IndexKind::Registry;
+    else
+        throw std::runtime_error("Unknown lookup type (expected file, component or registry)");
+
+    if (kind == IndexKind::Component)
+        Guid::Parse(key); // reject malformed ComponentId
+
+    FleetIndexReader index(index_file);
+    std::vector<uint32_t> packages = index.Lookup(kind, key);
+
+    if (kind == IndexKind::Registry) {
+        // Registry entries with Dynamic root are written to either HKLM or HKCU depending on ALLUSERS
+        std::wstring norm_key = NormalizeIndexKey(kind, key);
+        for (const wchar_t* root : {L"localmachine\\", L"currentuser\\"}) {
+            if (norm_key.compare(0, wcslen(root), root) == 0) {
+                std::vector<uint32_t> dynamic = index.Lookup(kind, L"dynamic\\" + norm_key.substr(wcslen(root)));
+                packages.insert(packages.end(), dynamic.begin(), dynamic.end());
+            }
+        }
+        std::sort(packages.begin(), packages.end());
+        packages.erase(std::unique(packages.begin(), packages.end()), packages.end());
+    }
+
+    std::wcout << L"Packages containing " << kind_str << L' ' << key << L":\n";
+    for (uint32_t package : packages)
+        std::wcout << L"  " << index.PackageName(package) << L'\n';
+    if (packages.empty())
+        std::wcout << L"  <none>\n";
+}
+
+
+/** Payload file hashes of a single package. */
+struct PackageHashes {
+    std::wstring                                       Package;
+    std::vector<std::pair<FileTable::Entry, FileHash>> Files;
+    size_t                                             Unhashed = 0; ///< files in external cabinets or uncompressed source
+    std::wstring                                       Error;
+};
+
+/** Hash all payload files in a MSI file. Uses MsiFileHash entries where present and decompresses embedded cabinets for the remaining files.
+    Only cabinets containing unhashed files are read, and the cabinet buffers of all threads are limited by a shared memory budget. */
+static PackageHashes HashMsiPayloads (const std::wstring& msi_file, MemoryBudget& cabinet_budget) {
+    PackageHashes result;
+    result.Package = msi_file;
+
+    MsiQuery query(msi_file);
+    FileTable files = query.QueryFile();
+
+    std::unordered_map<std::wstring, FileHash> hashes;
+    for (const FileHashEntry& entry : query.QueryFileHash()) {
+        FileHash hash;
+        hash.Part[0] = static_cast<uint32_t>(entry.HashPart1);
+        hash.Part[1] = static_cast<uint32_t>(entry.HashPart2);
+        hash.Part[2] = static_cast<uint32_t>(entry.HashPart3);
+        hash.Part[3] = static_cast<uint32_t>(entry.HashPart4);
+        hashes[entry.File_] = hash;
+    }
+
+    // files in a Media entry have sequence numbers above the LastSequence of the previous entry
+    std::vector<MediaEntry> media = query.QueryMedia();
+    std::sort(media.begin(), media.end(), [](const MediaEntry& a, const MediaEntry& b) {
+        return a.LastSequence < b.LastSequence;
+    });
+
+    // MsiFileHash only covers unversioned files, so EXE & DLL files are usually hashed from the cabinet payload
+    std::vector<std::unordered_set<std::string>> missing(media.size()); // unhashed files per Media entry
+    for (const FileTable::Entry& file : files.Entries()) {
+        if (hashes.count(file.File))
+            continue;
+
+        auto it = std::lower_bound(media.begin(), media.end(), file.Sequence, [](const MediaEntry& entry, int sequence) {
+            return entry.LastSequence < sequence;
+        });
+        if (it != media.end())
+            missing[it - media.begin()].insert(std::string(file.File.begin(), file.File.end())); // File keys are ASCII identifiers
+    }
+
+    MemoryBudget::Lease lease(cabinet_budget);
+    for (size_t idx = 0; idx < media.size(); ++idx) {
+        if (missing[idx].empty())
+            continue; // all files already hashed
+        if (media[idx].Cabinet.empty() || (media[idx].Cabinet[0] != L'#'))
+            continue; // external cabinet or uncompressed files
+
+        std::vector<char> cabinet = query.ReadStream(media[idx].Cabinet.substr(1), [&lease](size_t size) {
+            lease.Acquire(size);
+        });
+        if (cabinet.empty())
+            continue;
+
+        for (auto& entry : CabinetHasher::Hash(cabinet, missing[idx]))
+            hashes[std::wstring(entry.first.begin(), entry.first.end())] = entry.second;
+
+        cabinet = std::vector<char>(); // free buffer before returning its reservation
+        lease.Release();
+    }
+
+    for (const FileTable::Entry& file : files.Entries()) {
+        auto it = hashes.find(file.File);
+        if (it != hashes.end())
+            result.Files.push_back({file, it->second});
+        else
+            result.Unhashed++;
+    }
+
+    return result;
+}
+
+
+/** Detect identical payload files across many MSI files. Packages are hashed in parallel. */
+void DeduplicatePayloads (const std::vector<std::wstring>& inputs) {
+    std::vector<std::wstring> msi_files;
+    for (const std::wstring& input : inputs) {
+        std::vector<std::wstring> found = FindMsiFiles(input);
+        msi_files.insert(msi_files.end(), found.begin(), found.end());
+    }
+
+    std::vector<PackageHashes> packages(msi_files.size());
+    {
+        MemoryBudget cabinet_budget(1024u << 20); // buffered cabinets across all threads
+        std::atomic<size_t> next(0);
+        auto worker = [&]() {
+            for (size_t idx = next++; idx < msi_files.size(); idx = next++) {
+                try {
+                    packages[idx] = HashMsiPayloads(msi_files[idx], cabinet_budget);
+                } catch (const std::exception& err) {
+                    packages[idx].Package = msi_files[idx];
+                    packages[idx].Error = ToUnicode(err.what());
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        unsigned int thread_count = (std::max)(1u, std::thread::hardware_concurrency());
+        for (unsigned int i = 0; i < thread_count; ++i)
+            threads.emplace_back(worker);
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    // hash -> (package index, file entry index)
+    std::unordered_map<FileHash, std::vector<std::pair<uint32_t, uint32_t>>, FileHash::Hasher> payloads;
+    size_t file_count = 0, unhashed_count = 0;
+    for (uint32_t pkg = 0; pkg < packages.size(); ++pkg) {
+        if (!packages[pkg].Error.empty()) {
+            std::wcout << L"ERROR: " << packages[pkg].Package << L": " << packages[pkg].Error << L'\n';
+            continue;
+        }
+
+        for (uint32_t idx = 0; idx < packages[pkg].Files.size(); ++idx)
+            payloads[packages[pkg].Files[idx].second].push_back({pkg, idx});
+
+        file_count += packages[pkg].Files.size();
+        unhashed_count += packages[pkg].Unhashed;
+    }
+
+    std::wcout << L"Identical payload files:\n";
+    size_t group_count = 0;
+    uint64_t redundant_bytes = 0;
+    for (auto& payload : payloads) {
+        if (payload.second.size() < 2)
+            continue;
+
+        const FileTable::Entry& first = packages[payload.second[0].first].Files[payload.second[0].second].first;
+        std::wcout << L"  " << payload.first.ToString() << L" (" << first.FileSize << L" bytes, " << payload.second.size() << L" copies):\n";
+        for (auto& ref : payload.second) {
+            const FileTable::Entry& file = packages[ref.first].Files[ref.second].first;
+            std::wcout << L"    " << packages[ref.first].Package << L": " << file.LongFileName() << L'\n';
+        }
+
+        group_count++;
+        redundant_bytes += static_cast<uint64_t>(first.FileSize) * (payload.second.size() - 1);
+    }
+    if (group_count == 0)
+        std::wcout << L"  <none>\n";
+
+    std::wcout << L"\n";
+    std::wcout << L"Packages: " << packages.size() << L'\n';
+    std::wcout << L"Hashed files: " << file_count << L" (" << unhashed_count << L" files in external cabinets or uncompressed not hashed)\n";
+    std::wcout << L"Duplicated payloads: " << group_count << L'\n';
+    std::wcout << L"Redundant bytes: " << redundant_bytes << L'\n';
+}
+
+/** Check foreign keys, Directory tree and column values of MSI files. Returns the total number of violations, where a package that cannot be read counts as one. */
+size_t ValidateMsiFiles (const std::vector<std::wstring>& inputs) {
+    std::vector<std::wstring> msi_files;
+    for (const std::wstring& input : inputs) {
+        std::vector<std::wstring> found = FindMsiFiles(input);
+        msi_files.insert(msi_files.end(), found.begin(), found.end());
+    }
+
+    size_t issue_count = 0;
+    for (const std::wstring& msi_file : msi_files) {
+        std::wcout << L"Validating " << msi_file << L"...\n";
+
+        std::vector<ValidationIssue> issues;
+        size_t table_count = 0;
+        try {
+            std::vector<GenericTable> tables;
+            {
+                MsiQuery query(msi_file);
+                for (const std::wstring& table : query.QueryTableNames())
+                    tables.push_back(query.QueryTable(table));
+            }
+            table_count = tables.size();
+
+            issues = MsiValidator(std::move(tables)).Run();
+        } catch (const std::exception& err) {
+            // unreadable package counts as one issue, and validation continues with the next package
+            std::wcout << L"ERROR: " << msi_file << L": " << ToUnicode(err.what()) << L"\n\n";
+            issue_count++;
+            continue;
+        }
+
+        for (const ValidationIssue& issue : issues) {
+            std::wcout << L"  " << issue.Table << L'.' << issue.Column;
+            if (!issue.Key.empty())
+                std::wcout << L" [" << issue.Key << L']';
+            std::wcout << L": " << issue.Message << L'\n';
+        }
+        std::wcout << L"  " << issues.size() << L" issues in " << table_count << L" tables\n\n";
+        issue_count += issues.size();
+    }
+
+    return issue_count;
+}
+
+/** Export all tables of MSI files to Arrow IPC stream files in the output folder. */
+void ExportMsiTables (const std::wstring& folder, const std::vector<std::wstring>& inputs) {
+    std::vector<std::wstring> msi_files;
+    for (const std::wstring& input : inputs) {
+        std::vector<std::wstring> found = FindMsiFiles(input);
+        msi_files.insert(msi_files.end(), found.begin(), found.end());
+    }
+
+    CreateDirectoryW(folder.c_str(), nullptr); // might already exist
+    MsiArrowExporter exporter(folder);
+    for (const std::wstring& msi_file : msi_files) {
+        FILE* input = OpenFile(msi_file, L"rb");
+        if (!input) {
+            std::wcout << L"ERROR: " << msi_file << L": Unable to open file\n";
+            continue;
+        }
+
+        try {
+            exporter.AddPackage(msi_file, input);
+        } catch (const std::exception& err) {
+            std::wcout << L"ERROR: " << msi_file << L": " << ToUnicode(err.what()) << L'\n';
+        }
+        fclose(input);
+    }
+    exporter.Finish();
+
+    std::wcout << L"Packages: " << exporter.PackageCount() << L'\n';
+    std::wcout << L"Table files: " << exporter.FileCount() << L'\n';
+    std::wcout << L"Rows: " << exporter.RowCount() << L'\n';
+}
+
+
+static void PrintMsixManifest (const MsixManifest& manifest) {
+    std::wcout << (manifest.IsBundle ? L"MSIX bundle properties:\n" : L"MSIX properties:\n");
+    std::wcout << L"  Name: " << Utf8ToUnicode(manifest.Name) << L"\n";
+    std::wcout << L"  Version: " << Utf8ToUnicode(manifest.Version) << L"\n";
+    std::wcout << L"  Publisher: " << Utf8ToUnicode(manifest.Publisher) << L"\n";
+    if (!manifest.IsBundle) {
+        std::wcout << L"  ProcessorArchitecture: " << Utf8ToUnicode(manifest.ProcessorArchitecture) << L"\n";
+        std::wcout << L"  DisplayName: " << Utf8ToUnicode(manifest.DisplayName) << L"\n";
+        std::wcout << L"  PublisherDisplayName: " << Utf8ToUnicode(manifest.PublisherDisplayName) << L"\n";
+    }
+    std::wcout << L"\n";
+
+    if (manifest.IsBundle) {
+        std::wcout << L"Bundle packages:\n";
+        for (const MsixManifest::BundlePackage& package : manifest.Packages)
+            std::wcout << L"  " << Utf8ToUnicode(package.FileName) << L": " << Utf8ToUnicode(package.Type) << L' ' << Utf8ToUnicode(package.Architecture) << L' ' << Utf8ToUnicode(package.Version) << L'\n';
+        if (manifest.Packages.empty())
+            std::wcout << L"  <none>\n";
+        std::wcout << L"\n";
+        return;
+    }
+
+    std::wcout << L"Capabilities:\n";
+    for (const std::string& capability : manifest.Capabilities)
+        std::wcout << L"  " << Utf8ToUnicode(capability) << L'\n';
+    if (manifest.Capabilities.empty())
+        std::wcout << L"  <none>\n";
+    std::wcout << L"\n";
+
+    std::wcout << L"Applications:\n";
+    for (const MsixManifest::Application& app : manifest.Applications)
+        std::wcout << L"  " << Utf8ToUnicode(app.Id) << L": " << Utf8ToUnicode(app.Executable) << L' ' << Utf8ToUnicode(app.EntryPoint) << L'\n';
+    if (manifest.Applications.empty())
+        std::wcout << L"  <none>\n";
+    std::wcout << L"\n";
+
+    std::wcout << L"Extensions:\n";
+    for (const MsixManifest::Extension& ext : manifest.Extensions)
+        std::wcout << L"  " << Utf8ToUnicode(ext.Category) << L' ' << Utf8ToUnicode(ext.Executable) << L'\n';
+    if (manifest.Extensions.empty())
+        std::wcout << L"  <none>\n";
+    std::wcout << L"\n";
+}
+
+/** Offline analysis of a MSIX/AppX package or bundle. Only the manifest is decompressed, and bundled packages are parsed in-place when stored uncompressed. */
+static void AnalyzeMsixFile (const std::wstring& msix_file) {
+    std::wcout << L"Attempting to open file " << msix_file << L"...\n";
+    MappedFile file(msix_file);
+    ZipArchive archive(file.Data(), file.Size());
+
+    MsixManifest manifest = MsixManifest::Read(archive);
+    PrintMsixManifest(manifest);
+
+    for (const MsixManifest::BundlePackage& package : manifest.Packages) {
+        if (package.Type != "application")
+            continue; // skip resource packages
+
+        const ZipArchive::Entry* entry = archive.Find(package.FileName);
+        if (!entry) {
+            std::wcout << L"ERROR: " << Utf8ToUnicode(package.FileName) << L" not found in bundle\n\n";
+            continue;
+        }
+
+        std::wcout << L"Bundled package " << Utf8ToUnicode(package.FileName) << L":\n";
+        try {
+            std::vector<uint8_t> buffer;
+            const uint8_t* data = archive.StoredData(*entry); // bundled packages are normally stored
+            if (!data) {
+                buffer = archive.Extract(*entry);
+                data = buffer.data();
+            }
+            ZipArchive inner(data, static_cast<size_t>(entry->UncompressedSize));
+            PrintMsixManifest(MsixManifest::Read(inner));
+        } catch (const std::exception& err) {
+            std::wcout << L"  ERROR: " << ToUnicode(err.what()) << L"\n\n";
+        }
     }
-    return false;
 }
 
 
-std::wstring ParseMSIOrProductCode (std::wstring file_or_product) {
+Guid ParseMSIOrProductCode (std::wstring file_or_product) {
     PMSIHANDLE msi;
-    if (IsGUID(file_or_product)) {
+    Guid input_code;
+    if (Guid::TryParse(file_or_product, input_code)) {
         // input is a ProductCode
         //std::wcout << L"Attempting to open ProductCode " << file_or_product << L"...\n";
-        UINT ret = MsiOpenProductW(file_or_product.c_str(), &msi);
+        UINT ret = MsiOpenProductW(input_code.ToString().c_str(), &msi);
         if (ret != ERROR_SUCCESS)
             throw std::runtime_error("MsiOpenPackage failed");
     } else {
@@ -168,17 +675,19 @@ std::wstring ParseMSIOrProductCode (std::wstring file_or_product) {
             throw std::runtime_error("MsiOpenPackage unspecified error");
     }
 
-    std::wstring product_code;
+    Guid product_code;
     {
         // read properties
-        product_code = GetProductProperty(msi, L"ProductCode"); // REQUIRED
-        std::wstring upgrade_code = GetProductProperty(msi, L"UpgradeCode", false); // optional
+        product_code = Guid::Parse(GetProductProperty(msi, L"ProductCode")); // REQUIRED
+        std::wstring upgrade_str = GetProductProperty(msi, L"UpgradeCode", false); // optional
+        Guid upgrade_code; // null if absent or malformed
+        Guid::TryParse(upgrade_str, upgrade_code);
         std::wstring product_name = GetProductProperty(msi, L"ProductName"); // REQUIRED
         std::wstring product_ver = GetProductProperty(msi, L"ProductVersion"); // REQUIRED
         std::wstring manufacturer = GetProductProperty(msi, L"Manufacturer"); // REQUIRED
         std::wcout << L"MSI properties:\n";
-        std::wcout << L"  ProductCode: " << product_code << L"\n";
-        std::wcout << L"  UpgradeCode: " << upgrade_code << L"\n";
+        std::wcout << L"  ProductCode: " << product_code.ToString() << L"\n";
+        std::wcout << L"  UpgradeCode: " << (upgrade_code.IsNull() ? upgrade_str : upgrade_code.ToString()) << L"\n"; // malformed values printed as-is
         //std::wcout << L"  ProductName: " << product_name << L"\n";
         //std::wcout << L"  ProductVersion: " << product_ver << L"\n";
         //std::wcout << L"  Manufacturer: " << manufacturer << L"\n";
@@ -188,7 +697,7 @@ std::wstring ParseMSIOrProductCode (std::wstring file_or_product) {
 }
 
 
-std::wstring ParseInstalledApp (std::wstring product_code) {
+std::wstring ParseInstalledApp (const Guid& product_code) {
     // check if app is installed
     std::wstring msi_cache_file = GetProductInfo(product_code, INSTALLPROPERTY_LOCALPACKAGE); // Local cached package
     if (msi_cache_file.empty())
@@ -198,7 +707,9 @@ std::wstring ParseInstalledApp (std::wstring product_code) {
         std::wstring inst_loc = GetProductInfo(product_code, INSTALLPROPERTY_INSTALLLOCATION); // seem to be empty
         //std::wstring inst_folder = GetProductInfo(product_code, L"INSTALLFOLDER"); // not found
         std::wstring prod_id = GetProductInfo(product_code, INSTALLPROPERTY_PRODUCTID); // seem to be empty
-        std::wstring package_code = GetProductInfo(product_code, INSTALLPROPERTY_PACKAGECODE);
+        std::wstring package_str = GetProductInfo(product_code, INSTALLPROPERTY_PACKAGECODE);
+        Guid package_code; // null if not available
+        Guid::TryParse(package_str, package_code);
 
         std::wstring inst_name = GetProductInfo(product_code, INSTALLPROPERTY_INSTALLEDPRODUCTNAME); // seem identical to ProductName
         std::wstring publisher = GetProductInfo(product_code, INSTALLPROPERTY_PUBLISHER); // seem identical to Manufacturer
@@ -210,7 +721,7 @@ std::wstring ParseInstalledApp (std::wstring product_code) {
         std::wcout << L"  Version: " << version << L"\n";
         std::wcout << L"  Publisher: " << publisher << L"\n";
         std::wcout << L"  InstallDate: " << inst_date << L"\n";
-        std::wcout << L"  PackageCode: " << package_code << L"\n";
+        std::wcout << L"  PackageCode: " << (package_code.IsNull() ? package_str : package_code.ToString()) << L"\n";
         //std::wcout << L"  MSI cache: " << msi_cache_file << L"\n";
     }
 
@@ -222,19 +733,20 @@ void EnumerateInstalledProducts() {
     std::wcout << L"List of installed products:\n";
 
     for (DWORD idx = 0;; ++idx) {
-        std::wstring product_code(38, L'\0'); // fixed length
-        UINT ret = MsiEnumProductsW(idx, const_cast<wchar_t*>(product_code.data()));
+        wchar_t buffer[39] = {}; // fixed length incl. null-termination
+        UINT ret = MsiEnumProductsW(idx, buffer);
         if (ret == ERROR_NO_MORE_ITEMS)
             break;
         assert(ret == ERROR_SUCCESS);
+        Guid product_code = Guid::Parse(buffer);
 
         std::wcout << L"\n";
-        std::wcout << idx << L": ProductCode: " << product_code << L'\n';
+        std::wcout << idx << L": ProductCode: " << product_code.ToString() << L'\n';
 #ifdef FAST_MODE_WITHOUT_UpgradeCode
         std::wstring msi_cache_file = ParseInstalledApp(product_code);
 #else
         try {
-            ParseMSIOrProductCode(product_code); // slower, but also gives UpgradeCode
+            ParseMSIOrProductCode(product_code.ToString()); // slower, but also gives UpgradeCode
             ParseInstalledApp(product_code);
         } catch (const std::exception & err) {
             std::wcout << L"  ERROR: " << ToUnicode(err.what()) << L'\n';
@@ -245,11 +757,20 @@ void EnumerateInstalledProducts() {
 
 
 int wmain (int argc, wchar_t *argv[]) {
-    // enable unicode characters in console output
-    _setmode(_fileno(stdout), _O_U16TEXT);
+    // enable unicode characters in console output (UTF-8 when redirected)
+    Utf8OutputBuf stdout_buf(std::wcout, stdout);
 
     if (argc < 2) {
         std::wcout << L"Usage: " << argv[0] << L" [*|<filename.msi>|{ProductCode}|{UpgradeCode}]\n";
+        std::wcout << L"       " << argv[0] << L" -   (read MSI file from stdin)\n";
+        std::wcout << L"       " << argv[0] << L" --index <index-file> <filename.msi|folder>...\n";
+        std::wcout << L"       " << argv[0] << L" --lookup <index-file> [file|component|registry] <key>\n";
+        std::wcout << L"       " << argv[0] << L" --dedup <filename.msi|folder>...\n";
+        std::wcout << L"       " << argv[0] << L" --export <output-folder> <filename.msi|folder>...\n";
+        std::wcout << L"       " << argv[0] << L" --hive <SOFTWARE-hive> <filename.msi|folder>...\n";
+        std::wcout << L"       " << argv[0] << L" --validate <filename.msi|folder>...\n";
+        std::wcout << L"       " << argv[0] << L" --watch <folder> <summary-file.tsv>\n";
+        std::wcout << L"       " << argv[0] << L" <filename.msix|.appx|.msixbundle|.appxbundle>\n";
         return 1;
     }
 
@@ -262,15 +783,38 @@ int wmain (int argc, wchar_t *argv[]) {
         std::wstring argument = argv[1];
         if (argument == L"*") {
             EnumerateInstalledProducts();
+        } else if (argument == L"-") {
+            AnalyzeMsiStream();
+        } else if ((argument == L"--index") && (argc >= 4)) {
+            BuildFleetIndex(argv[2], std::vector<std::wstring>(argv + 3, argv + argc));
+        } else if ((argument == L"--lookup") && (argc == 5)) {
+            LookupFleetIndex(argv[2], argv[3], argv[4]);
+        } else if ((argument == L"--dedup") && (argc >= 3)) {
+            DeduplicatePayloads(std::vector<std::wstring>(argv + 2, argv + argc));
+        } else if ((argument == L"--export") && (argc >= 4)) {
+            ExportMsiTables(ToAbsolutePath(argv[2]), std::vector<std::wstring>(argv + 3, argv + argc));
+        } else if ((argument == L"--hive") && (argc >= 4)) {
+            AnalyzeMsiFilesWithHive(ToAbsolutePath(argv[2]), std::vector<std::wstring>(argv + 3, argv + argc));
+        } else if ((argument == L"--validate") && (argc >= 3)) {
+            size_t issue_count = ValidateMsiFiles(std::vector<std::wstring>(argv + 2, argv + argc));
+            return (issue_count > 0) ? 1 : 0;
+        } else if ((argument == L"--watch") && (argc == 4)) {
+            PackageWatcher watcher(argv[2], argv[3]);
+            watcher.Run();
+        } else if (HasMsixExtension(argument)) {
+            AnalyzeMsixFile(ToAbsolutePath(argument));
         } else {
             // check if input is UpgradeCode
-            auto product_code = GetFirstProductCode(argument);
-            if (!product_code.empty()) {
-                std::wcout << L"UpgradeCode " << argument << L" is associated with ProductCode " << product_code << L"\n";
-                argument = product_code;
+            Guid upgrade_code;
+            if (Guid::TryParse(argument, upgrade_code)) {
+                Guid related_code = GetFirstProductCode(upgrade_code);
+                if (!related_code.IsNull()) {
+                    std::wcout << L"UpgradeCode " << argument << L" is associated with ProductCode " << related_code.ToString() << L"\n";
+                    argument = related_code.ToString();
+                }
             }
 
-            product_code = ParseMSIOrProductCode(argument);
+            Guid product_code = ParseMSIOrProductCode(argument);
             std::wstring msi_cache_file = ParseInstalledApp(product_code);
             std::wcout << L"\n";
             if (msi_cache_file.size() > 0) {
@@ -286,6 +830,7 @@ int wmain (int argc, wchar_t *argv[]) {
             }
         }
     } catch (std::exception & e) {
+        std::wcout.flush();
         std::cerr << "ERROR: " << e.what() << std::endl;
         return -1;
     }
@@ -0,0 +1,146 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifndef _WIN32
+/** Convert wide path to multi-byte string in the current locale. */
+inline std::string ToNarrowPath(const std::wstring& path) {
+    size_t len = wcstombs(nullptr, path.c_str(), 0);
+    if (len == static_cast<size_t>(-1))
+        throw std::runtime_error("Unable to convert path");
+
+    std::string buffer(len, '\0');
+    wcstombs(const_cast<char*>(buffer.data()), path.c_str(), len + 1);
+    return buffer;
+}
+#endif
+
+/** Open a file with a wide-character path. Returns nullptr on failure. */
+inline FILE* OpenFile(const std::wstring& path, const wchar_t* mode) {
+#ifdef _WIN32
+    FILE* file = nullptr;
+    if (_wfopen_s(&file, path.c_str(), mode) != 0)
+        return nullptr;
+    return file;
+#else
+    std::wstring w_mode(mode);
+    return fopen(ToNarrowPath(path).c_str(), std::string(w_mode.begin(), w_mode.end()).c_str());
+#endif
+}
+
+/** Replace "to" with "from". Used for atomic updates of output files. */
+inline void ReplaceFile(const std::wstring& from, const std::wstring& to) {
+#ifdef _WIN32
+    if (!MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING))
+        throw std::runtime_error("MoveFileEx failed");
+#else
+    if (rename(ToNarrowPath(from).c_str(), ToNarrowPath(to).c_str()) != 0)
+        throw std::runtime_error("rename failed");
+#endif
+}
+
+
+/** Read-only memory-mapped file. */
+class MappedFile {
+public:
+    explicit MappedFile(const std::wstring& path) {
+#ifdef _WIN32
+        m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Unable to open file");
+
+        LARGE_INTEGER size = {};
+        GetFileSizeEx(m_file, &size);
+        m_size = static_cast<size_t>(size.QuadPart);
+        if (m_size == 0)
+            return; // cannot map empty files
+
+        m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m_mapping) {
+            Close();
+            throw std::runtime_error("CreateFileMapping failed");
+        }
+
+        m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!m_data) {
+            Close();
+            throw std::runtime_error("MapViewOfFile failed");
+        }
+#else
+        m_fd = open(ToNarrowPath(path).c_str(), O_RDONLY);
+        if (m_fd < 0)
+            throw std::runtime_error("Unable to open file");
+
+        struct stat st = {};
+        fstat(m_fd, &st);
+        m_size = static_cast<size_t>(st.st_size);
+        if (m_size == 0)
+            return; // cannot map empty files
+
+        void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+        if (data == MAP_FAILED) {
+            Close();
+            throw std::runtime_error("mmap failed");
+        }
+        m_data = static_cast<const uint8_t*>(data);
+#endif
+    }
+
+    ~MappedFile() {
+        Close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator = (const MappedFile&) = delete;
+
+    const uint8_t* Data() const {
+        return m_data;
+    }
+
+    size_t Size() const {
+        return m_size;
+    }
+
+private:
+    void Close() {
+#ifdef _WIN32
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE)
+            CloseHandle(m_file);
+        m_mapping = nullptr;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        if (m_data)
+            munmap(const_cast<uint8_t*>(m_data), m_size);
+        if (m_fd >= 0)
+            close(m_fd);
+        m_fd = -1;
+#endif
+        m_data = nullptr;
+    }
+
+#ifdef _WIN32
+    HANDLE         m_file = INVALID_HANDLE_VALUE;
+    HANDLE         m_mapping = nullptr;
+#else
+    int            m_fd = -1;
+#endif
+    const uint8_t* m_data = nullptr;
+    size_t         m_size = 0;
+};
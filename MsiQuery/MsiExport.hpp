@@ -0,0 +1,216 @@
+#pragma once
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ArrowWriter.hpp"
+#include "MappedFile.hpp"
+#include "MsiStreamQuery.hpp"
+
+
+/** Export all tables of many MSI files to one Arrow IPC stream file per table, like "File.arrows".
+    Package, ProductCode and ProductVersion columns are added in front of the table columns.
+    String columns are dictionary-encoded, where each string pool ID is only converted once per package. */
+class MsiArrowExporter {
+public:
+    MsiArrowExporter(const std::wstring& folder) : m_folder(folder) {
+    }
+
+    ~MsiArrowExporter() {
+        for (auto& table : m_outputs) {
+            for (auto& output : table.second)
+                fclose(output->File);
+        }
+    }
+
+    /** Export tables of a package. The input is read in a single forward pass.
+        The whole package is decoded and validated before any row is written, so that a corrupt package is either exported completely or not at all. */
+    void AddPackage(const std::wstring& package, FILE* input) {
+        MsiStreamQuery query(input, 256u << 20, true);
+        const MsiStringPool& strings = query.Strings();
+
+        PropertyTable properties = query.QueryProperty();
+        const std::wstring* product_code = properties.Find(L"ProductCode");
+        const std::wstring* product_version = properties.Find(L"ProductVersion");
+        const std::string identity[] = {ToUtf8(package), product_code ? ToUtf8(*product_code) : "", product_version ? ToUtf8(*product_version) : ""};
+
+        std::vector<std::wstring>        names;
+        std::vector<MsiStreamTable>      tables;
+        std::vector<std::vector<size_t>> table_columns;
+        std::vector<Fields>              table_fields;
+        std::vector<std::string>         utf8(strings.Size()); // referenced strings, converted once per package
+        std::vector<bool>                converted(strings.Size());
+        for (const std::wstring& name : query.TableNames()) {
+            names.push_back(name);
+            tables.push_back(query.Table(name));
+            const MsiStreamTable& table = tables.back();
+
+            // binary columns refer to separate streams that are not exported
+            std::vector<size_t> columns;
+            for (size_t col = 0; col < table.Columns().size(); ++col) {
+                if (!IsBinary(table.Columns()[col].Type))
+                    columns.push_back(col);
+            }
+
+            for (size_t col : columns) {
+                if (!(table.Columns()[col].Type & MsiStreamTable::MSITYPE_STRING))
+                    continue;
+
+                for (size_t row = 0; row < table.Rows(); ++row) {
+                    uint32_t raw = table.GetRaw(row, col);
+                    if ((raw == 0) || ((raw < converted.size()) && converted[raw]))
+                        continue;
+
+                    strings.Encoded(raw).AppendUtf8(utf8[raw]); // throws on invalid string references
+                    converted[raw] = true;
+                }
+            }
+
+            table_fields.push_back(GetFields(table, columns));
+            table_columns.push_back(std::move(columns));
+        }
+
+        // output files are only created once the whole package is decoded, and rows are only written once all outputs are open
+        std::vector<Output*> outputs;
+        for (size_t i = 0; i < tables.size(); ++i)
+            outputs.push_back(&GetOutput(names[i], table_fields[i]));
+
+        for (size_t i = 0; i < tables.size(); ++i)
+            WriteRows(*outputs[i]->Writer, tables[i], table_columns[i], utf8, identity);
+        m_packages++;
+    }
+
+    /** Complete all output files. */
+    void Finish() {
+        for (auto& table : m_outputs) {
+            for (auto& output : table.second)
+                output->Writer->Close();
+        }
+    }
+
+    size_t PackageCount() const {
+        return m_packages;
+    }
+
+    /** Number of output files. */
+    size_t FileCount() const {
+        size_t count = 0;
+        for (auto& table : m_outputs)
+            count += table.second.size();
+        return count;
+    }
+
+    uint64_t RowCount() const {
+        uint64_t count = 0;
+        for (auto& table : m_outputs) {
+            for (auto& output : table.second)
+                count += output->Writer->RowCount();
+        }
+        return count;
+    }
+
+private:
+    static const size_t IDENTITY_COLUMNS = 3;
+
+    typedef std::vector<ArrowStreamWriter::Field> Fields;
+
+    /** Output file for a table schema. Tables with the same name but different columns are written to separate files. */
+    struct Output {
+        MsiArrowExporter::Fields              Fields;
+        FILE*                                 File = nullptr;
+        std::unique_ptr<ArrowStreamWriter>    Writer;
+    };
+
+    static bool IsBinary(int type) {
+        return (type & ~MsiStreamTable::MSITYPE_NULLABLE) == (MsiStreamTable::MSITYPE_STRING | MsiStreamTable::MSITYPE_VALID);
+    }
+
+    /** Identity columns followed by the exported table columns. */
+    static Fields GetFields(const MsiStreamTable& table, const std::vector<size_t>& columns) {
+        typedef ArrowStreamWriter::ColumnType ColumnType;
+        Fields fields = {{"Package", ColumnType::DictionaryUtf8}, {"ProductCode", ColumnType::DictionaryUtf8}, {"ProductVersion", ColumnType::DictionaryUtf8}};
+        for (size_t col : columns) {
+            const MsiStreamTable::Column& column = table.Columns()[col];
+            ColumnType type = ColumnType::DictionaryUtf8;
+            if (!(column.Type & MsiStreamTable::MSITYPE_STRING))
+                type = (column.Width == 2) ? ColumnType::Int16 : ColumnType::Int32;
+            fields.push_back({ToUtf8(column.Name), type});
+        }
+        return fields;
+    }
+
+    /** Find or create the output file with matching fields. */
+    Output& GetOutput(const std::wstring& name, const Fields& fields) {
+        std::vector<std::unique_ptr<Output>>& variants = m_outputs[name];
+        for (auto& output : variants) {
+            bool match = (output->Fields.size() == fields.size()) && std::equal(fields.begin(), fields.end(), output->Fields.begin(), [](const ArrowStreamWriter::Field& a, const ArrowStreamWriter::Field& b) {
+                return (a.Name == b.Name) && (a.Type == b.Type);
+            });
+            if (match)
+                return *output;
+        }
+
+        std::wstring path = m_folder + L"/" + name;
+        if (!variants.empty())
+            path += L"~" + std::to_wstring(variants.size() + 1);
+        path += L".arrows";
+
+        std::unique_ptr<Output> output(new Output());
+        output->Fields = fields;
+        output->File = OpenFile(path, L"wb");
+        if (!output->File)
+            throw std::runtime_error("Unable to create output file");
+        output->Writer.reset(new ArrowStreamWriter(output->File, fields));
+        variants.push_back(std::move(output));
+        return *variants.back();
+    }
+
+    /** Append rows of a validated table. "utf8" contains all strings referenced by the table. */
+    static void WriteRows(ArrowStreamWriter& writer, const MsiStreamTable& table, const std::vector<size_t>& columns, const std::vector<std::string>& utf8, const std::string identity[IDENTITY_COLUMNS]) {
+        uint32_t generation = writer.DictionaryGeneration() + 1; // force initialization
+        int32_t identity_idx[IDENTITY_COLUMNS] = {};
+        std::vector<std::vector<int32_t>> string_idx(columns.size()); // string ID -> dictionary index (-1 if not yet added)
+
+        for (size_t row = 0; row < table.Rows(); ++row) {
+            if (writer.DictionaryGeneration() != generation) {
+                // dictionaries have been replaced
+                generation = writer.DictionaryGeneration();
+                for (size_t i = 0; i < IDENTITY_COLUMNS; ++i)
+                    identity_idx[i] = writer.DictionaryIndex(i, identity[i]);
+                for (std::vector<int32_t>& mapping : string_idx)
+                    mapping.clear();
+            }
+
+            for (size_t i = 0; i < IDENTITY_COLUMNS; ++i) {
+                if (identity[i].empty())
+                    writer.AppendNull(i);
+                else
+                    writer.AppendIndex(i, identity_idx[i]);
+            }
+
+            for (size_t i = 0; i < columns.size(); ++i) {
+                const size_t out_col = IDENTITY_COLUMNS + i;
+                uint32_t raw = table.GetRaw(row, columns[i]);
+                if (raw == 0) {
+                    writer.AppendNull(out_col);
+                } else if (table.Columns()[columns[i]].Type & MsiStreamTable::MSITYPE_STRING) {
+                    std::vector<int32_t>& mapping = string_idx[i];
+                    if (mapping.empty())
+                        mapping.resize(utf8.size(), -1);
+
+                    if (mapping[raw] < 0)
+                        mapping[raw] = writer.DictionaryIndex(out_col, utf8[raw]);
+                    writer.AppendIndex(out_col, mapping[raw]);
+                } else {
+                    writer.AppendInt(out_col, table.GetInt(row, columns[i]));
+                }
+            }
+            writer.EndRow();
+        }
+    }
+
+    std::wstring m_folder;
+    std::map<std::wstring, std::vector<std::unique_ptr<Output>>> m_outputs; ///< table name -> schema variants
+    size_t m_packages = 0;
+};
@@ -0,0 +1,304 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MsiQuery.hpp"
+
+
+/** Compiled template for the MSI "Formatted" data type.
+    The template string is parsed once into a sequence of literal and lookup operations that can afterwards be expanded repeatedly.
+    REF: https://learn.microsoft.com/en-us/windows/win32/msi/formatted */
+class FormattedTemplate {
+public:
+    enum OpType : unsigned char {
+        Literal,       ///< verbatim text
+        Property,      ///< [Property]
+        FilePath,      ///< [#File] full path to file
+        FileShortPath, ///< [!File] full short path to file
+        ComponentDir,  ///< [$Component] install directory of component
+        Environment,   ///< [%Env] environment variable
+        GroupBegin,    ///< start of {...} group that is omitted if any property inside is empty
+        GroupEnd,
+    };
+
+    struct Op {
+        OpType       Type;
+        std::wstring Text;      ///< literal text or lookup key
+        size_t       GroupEnd;  ///< index of matching GroupEnd op (only for GroupBegin)
+    };
+
+    FormattedTemplate() = default;
+
+    explicit FormattedTemplate(const std::wstring& format) {
+        Compile(format, 0, format.size());
+    }
+
+    /** Expand template. The resolver must provide a "std::wstring Resolve(OpType, const std::wstring& key)" method. */
+    template <class Resolver>
+    std::wstring Expand(Resolver& resolver) const {
+        std::wstring result;
+        bool has_empty = false;
+        ExpandRange(resolver, 0, m_ops.size(), result, has_empty);
+        return result;
+    }
+
+private:
+    template <class Resolver>
+    void ExpandRange(Resolver& resolver, size_t begin, size_t end, std::wstring& result, bool& has_empty) const {
+        for (size_t i = begin; i < end; ++i) {
+            const Op& op = m_ops[i];
+            switch (op.Type) {
+            case Literal:
+                result += op.Text;
+                break;
+            case GroupBegin:
+                {
+                    // group is omitted if any of the lookups inside resolve to an empty string
+                    std::wstring group;
+                    bool group_empty = false;
+                    ExpandRange(resolver, i + 1, op.GroupEnd, group, group_empty);
+                    if (!group_empty)
+                        result += group;
+                    i = op.GroupEnd;
+                }
+                break;
+            case GroupEnd:
+                break;
+            default:
+                {
+                    std::wstring value = resolver.Resolve(op.Type, op.Text);
+                    if (value.empty())
+                        has_empty = true;
+                    result += value;
+                }
+            }
+        }
+    }
+
+    /** Compile format[begin, end) and append the resulting ops. */
+    void Compile(const std::wstring& format, size_t begin, size_t end) {
+        size_t pos = begin;
+        while (pos < end) {
+            const wchar_t c = format[pos];
+            if (c == L'[') {
+                size_t close = format.find(L']', pos + 1);
+                if ((close == std::wstring::npos) || (close >= end)) {
+                    AddLiteral(format.substr(pos, end - pos)); // unterminated
+                    break;
+                }
+                if ((close == pos + 2) && (format[pos + 1] == L'\\') && (close + 1 < end) && (format[close + 1] == L']')) {
+                    AddLiteral(L"]"); // "[\]]" escape
+                    pos = close + 2;
+                    continue;
+                }
+
+                AddBracket(format.substr(pos + 1, close - pos - 1));
+                pos = close + 1;
+            } else if (c == L'{') {
+                size_t close = FindGroupEnd(format, pos + 1, end);
+                if (close == std::wstring::npos) {
+                    AddLiteral(L"{"); // unterminated or nested
+                    ++pos;
+                    continue;
+                }
+
+                size_t group_idx = m_ops.size();
+                m_ops.push_back({GroupBegin, L"", 0});
+                Compile(format, pos + 1, close);
+
+                bool has_lookup = false;
+                for (size_t i = group_idx + 1; i < m_ops.size(); ++i)
+                    has_lookup |= (m_ops[i].Type != Literal);
+
+                if (has_lookup) {
+                    m_ops[group_idx].GroupEnd = m_ops.size();
+                    m_ops.push_back({GroupEnd, L"", 0});
+                } else {
+                    // groups without lookups are left unchanged, including braces
+                    m_ops.resize(group_idx);
+                    AddLiteral(format.substr(pos, close - pos + 1));
+                }
+                pos = close + 1;
+            } else {
+                size_t next = format.find_first_of(L"[{", pos);
+                if ((next == std::wstring::npos) || (next > end))
+                    next = end;
+                AddLiteral(format.substr(pos, next - pos));
+                pos = next;
+            }
+        }
+    }
+
+    /** Find closing brace while skipping over [...] segments that might contain escaped braces. */
+    static size_t FindGroupEnd(const std::wstring& format, size_t pos, size_t end) {
+        while (pos < end) {
+            if (format[pos] == L'}')
+                return pos;
+            if (format[pos] == L'{')
+                return std::wstring::npos; // nested groups not supported
+
+            if (format[pos] == L'[') {
+                size_t close = format.find(L']', pos + 1);
+                if ((close == std::wstring::npos) || (close >= end))
+                    return std::wstring::npos;
+                pos = close;
+            }
+            ++pos;
+        }
+        return std::wstring::npos;
+    }
+
+    void AddBracket(const std::wstring& name) {
+        if (name.empty()) {
+            AddLiteral(L"[]");
+            return;
+        }
+
+        switch (name[0]) {
+        case L'\\':
+            if (name.size() == 2)
+                AddLiteral(name.substr(1)); // escaped character
+            else
+                AddLiteral(L'[' + name + L']');
+            return;
+        case L'~':
+            AddLiteral(L"[~]"); // null character (REG_MULTI_SZ separator) is kept for display
+            return;
+        case L'#':
+            m_ops.push_back({FilePath, name.substr(1), 0});
+            return;
+        case L'!':
+            m_ops.push_back({FileShortPath, name.substr(1), 0});
+            return;
+        case L'$':
+            m_ops.push_back({ComponentDir, name.substr(1), 0});
+            return;
+        case L'%':
+            m_ops.push_back({Environment, name.substr(1), 0});
+            return;
+        }
+
+        if (name.find(L'[') != std::wstring::npos) {
+            AddLiteral(L'[' + name + L']'); // nested properties not supported
+            return;
+        }
+
+        m_ops.push_back({Property, name, 0});
+    }
+
+    void AddLiteral(const std::wstring& text) {
+        if (text.empty())
+            return;
+
+        if (!m_ops.empty() && (m_ops.back().Type == Literal))
+            m_ops.back().Text += text; // merge adjacent literals
+        else
+            m_ops.push_back({Literal, text, 0});
+    }
+
+    std::vector<Op> m_ops;
+};
+
+
+/** Expands Formatted column values against the Property, Directory, File & Component tables of a package.
+    Compiled templates and resolved directory paths are cached, so that repeated values are only parsed once. */
+class FormattedExpander {
+public:
+    FormattedExpander(const PropertyTable& properties, const DirectoryTable& directories, const FileTable& files, const ComponentTable& components)
+        : m_properties(properties), m_directories(directories), m_files(files), m_components(components) {
+    }
+
+    /** Expand a Formatted string. */
+    std::wstring Format(const std::wstring& value) {
+        if (value.find_first_of(L"[{") == std::wstring::npos)
+            return value; // fast path for plain strings
+
+        auto it = m_templates.find(value);
+        if (it == m_templates.end())
+            it = m_templates.emplace(value, FormattedTemplate(value)).first;
+
+        return it->second.Expand(*this);
+    }
+
+    /** Lookup callback used by FormattedTemplate::Expand. */
+    std::wstring Resolve(FormattedTemplate::OpType type, const std::wstring& key) {
+        switch (type) {
+        case FormattedTemplate::Property:
+            {
+                const std::wstring* value = m_properties.Find(key);
+                if (value)
+                    return *value;
+
+                // directory names are also properties that resolve to a folder path
+                return DirectoryPath(key);
+            }
+        case FormattedTemplate::FilePath:
+        case FormattedTemplate::FileShortPath:
+            {
+                FileTable::Entry file = m_files.Lookup(key, false);
+                if (file.File.empty())
+                    return L"";
+
+                std::wstring name = file.LongFileName();
+                if (type == FormattedTemplate::FileShortPath) {
+                    size_t idx = file.FileName.find(L'|');
+                    name = file.FileName.substr(0, idx); // short-name prefix
+                }
+                return DirectoryPath(ComponentDirectory(file.Component_)) + name;
+            }
+        case FormattedTemplate::ComponentDir:
+            return DirectoryPath(ComponentDirectory(key));
+        case FormattedTemplate::Environment:
+            {
+                DWORD buf_len = GetEnvironmentVariableW(key.c_str(), nullptr, 0);
+                if (buf_len == 0)
+                    return L""; // not found
+
+                std::wstring buffer(buf_len - 1, L'\0'); // subtract null-termination
+                GetEnvironmentVariableW(key.c_str(), const_cast<wchar_t*>(buffer.data()), buf_len);
+                return buffer;
+            }
+        default:
+            return L"";
+        }
+    }
+
+private:
+    /** Directory path with trailing backslash, or "" if not found. */
+    const std::wstring& DirectoryPath(const std::wstring& directory) {
+        auto it = m_dir_paths.find(directory);
+        if (it != m_dir_paths.end())
+            return it->second;
+
+        std::wstring& path = m_dir_paths[directory]; // empty placeholder also guards against Directory_Parent cycles
+        const DirectoryTable::Entry* entry = directory.empty() ? nullptr : m_directories.Find(directory);
+        if (entry) {
+            // resolve parent first, so that all ancestors end up in the cache
+            std::wstring parent;
+            if (entry->Directory_Parent != directory)
+                parent = DirectoryPath(entry->Directory_Parent);
+            if (parent.empty())
+                parent = L"\\"; // root or dangling parent
+            path = parent + entry->LongDefaultDir() + L'\\';
+        }
+
+        return path;
+    }
+
+    std::wstring ComponentDirectory(const std::wstring& component) const {
+        try {
+            return m_components.Lookup(component).Directory_;
+        } catch (const std::exception&) {
+            return L""; // dangling component reference
+        }
+    }
+
+    const PropertyTable&  m_properties;
+    const DirectoryTable& m_directories;
+    const FileTable&      m_files;
+    const ComponentTable& m_components;
+
+    std::unordered_map<std::wstring, FormattedTemplate> m_templates; ///< compiled template cache
+    std::unordered_map<std::wstring, std::wstring>      m_dir_paths; ///< resolved directory path cache
+};
@@ -7,300 +7,7 @@
 #include <Windows.h>
 #include <msiquery.h>
 #include <MsiDefs.h>
-
-
-/** https://learn.microsoft.com/en-us/windows/win32/msi/feature-table */
-struct FeatureEntry {
-    std::wstring Feature;     ///< feature identifier [max 38 chars]
-    //std::wstring Feature_Parent;
-    std::wstring Title;       ///< short description
-    std::wstring Description; ///< longer description [localizable]
-    int Display = 0;          ///< UI order
-    int Level = 0;            ///< 0=disables installation
-    //std::wstring Directory_;
-    int Attributes = 0;
-
-    std::wstring ToString() const {
-        return L"Title=" + Title + L", Description=" + Description + L", Feature=" + Feature;
-    }
-};
-
-
-/** https://docs.microsoft.com/en-us/windows/win32/msi/customaction-table */
-struct CustomActionEntry {
-    /** CustomAction type parser.
-    *   Based on msidbCustomActionType enum in <msidefs.h>
-    *   REF: https://docs.microsoft.com/en-us/windows/win32/msi/summary-list-of-all-custom-action-types
-    *
-    *   Wix custom actions:
-    *    Type 65   (0x041)  =                                                                Continue(0x40)                    + Dll(0x01) // ValidatePath, PrintEula
-    *   Custom DLL:
-    *    Type               =                                                                                                  + Dll(0x01) // Type 1/17 run DLL
-    *   Custom EXE:
-    *    Type 3106 (0x0C22) =                       NoImpersonate(0x800) + Deferred(0x400)                  + Directory(0x20)  + Exe(0x02) // Type 2/18/34/50 run executable
-    *    Type 3170 (0x0C62) =                       NoImpersonate(0x800) + Deferred(0x400) + Continue(0x40) + Directory(0x20)  + Exe(0x02)
-    *   Custom JScript:
-    *    Type 7189 (0x1C15) = Script64Bit(0x1000) + NoImpersonate(0x800) + Deferred(0x400) +                  SourceFile(0x10) + Script(0x04) + Dll(0x01) // Type 5/21/37/53 JScript
-    *    Type 7253 (0x1C55) = Script64Bit(0x1000) + NoImpersonate(0x800) + Deferred(0x400) + Continue(0x40) + SourceFile(0x10) + Script(0x04) + Dll(0x01)
-    *   Custom VBScript:
-    *    Type               =                                                                                                  + Script(0x04) + Exe(0x02) // Type 6/22/38/54 VBScript
-    */
-    struct Type {
-        Type() {
-            memset(this, 0, sizeof(Type)); // replace with default member initializers after upgrading to newer C++ version
-        }
-
-        /** Parse MSI CustomAction "Type" column. */
-        Type(int val) {
-            (int&)(*this) = val;
-        }
-
-        std::wstring ToString() const {
-            std::wstring res = L"[";
-            if (Dll) res += L"Dll,";
-            if (Exe) res += L"Exe,";
-            if (Script) res += L"Script,";
-            if (SourceFile) res += L"SourceFile,";
-            if (Directory) res += L"Directory,";
-            if (Continue) res += L"Continue,";
-            if (Async) res += L"Async,";
-            if (Rollback) res += L"Rollback,";
-            if (Commit) res += L"Commit,";
-            if (Deferred) res += L"Deferred,";
-            if (NoImpersonate) res += L"NoImpersonate,";
-            if (Script64Bit) res += L"Script64Bit,";
-            if (HideTarget) res += L"HideTarget,";
-            if (TSAware) res += L"TSAware,";
-            if (PatchUninstall) res += L"PatchUninstall,";
-            return res.substr(0, res.size() - 1) + L"]";
-        }
-
-        operator int& () {
-            return *reinterpret_cast<int*>(this);
-        }
-        operator const int& () const {
-            return *reinterpret_cast<const int*>(this);
-        }
-
-        /** Special combinations:
-        *   msidbCustomActionTypeTextData (0x03) = Dll | Exe
-        *   msidbCustomActionTypeJScript (0x05) = 0x04 | Dll
-        *   msidbCustomActionTypeVBScript (0x06) = 0x04 | Dll
-        *   msidbCustomActionTypeInstall (0x07) = 0x04 | Exe | Dll
-        *   msidbCustomActionTypeProperty (0x30) = Directory | File
-        *   msidbCustomActionTypeClientRepeat (0x300) = FirstSequence + OncePerProcess */
-        bool Dll : 1; ///< msidbCustomActionTypeDll (0x01)
-        bool Exe : 1; ///< msidbCustomActionTypeExe (0x02)
-        bool Script : 1; ///< script (used by msidbCustomActionTypeJScript (0x05) and msidbCustomActionTypeVBScript (0x06))
-        bool _padding1 : 1;
-        bool SourceFile : 1; ///< msidbCustomActionTypeSourceFile (0x10)
-        bool Directory : 1; ///< msidbCustomActionTypeDirectory (0x20)
-        bool Continue : 1; ///< msidbCustomActionTypeContinue (0x40)
-        bool Async : 1; ///< msidbCustomActionTypeAsync (0x80)
-        bool Rollback : 1; ///< msidbCustomActionTypeFirstSequence or msidbCustomActionTypeRollback (0x100)
-        bool Commit : 1; ///< msidbCustomActionTypeOncePerProcess or msidbCustomActionTypeCommit (0x200)
-        bool Deferred : 1; ///< msidbCustomActionTypeInScript (0x400) (deferred execution)
-        bool NoImpersonate : 1; ///< msidbCustomActionTypeNoImpersonate (0x800) - run as ADMIN
-        bool Script64Bit : 1; ///< msidbCustomActionType64BitScript (0x1000)
-        bool HideTarget : 1; ///< msidbCustomActionTypeHideTarget (0x2000)
-        bool TSAware : 1; ///< msidbCustomActionTypeTSAware (0x4000) (Terminal Server)
-        bool PatchUninstall : 1; ///< msidbCustomActionTypePatchUninstall (0x8000)
-        bool _padding2 : 8;
-        bool _padding3 : 8;
-    };
-    static_assert(sizeof(Type) == sizeof(int), "CustomAction::Type size mismatch");
-
-
-    std::wstring Action;
-    Type         Type;
-    std::wstring Source;
-    std::wstring Target;
-    std::wstring ExtendedType;
-};
-
-
-/** https://docs.microsoft.com/en-us/windows/win32/msi/registry-table */
-struct RegEntry {
-    enum RootType : int {
-        Dynamic      = -1,// HKEY_CURRENT_USER or HKEY_LOCAL_MACHINE, depending on ALLUSERS
-        ClassesRoot  = 0, // HKEY_CLASSES_ROOT
-        CurrentUser  = 1, // HKEY_CURRENT_USER
-        LocalMachine = 2, // HKEY_LOCAL_MACHINE
-        Users        = 3, // HKEY_USERS
-    };
-
-    std::wstring RootStr () const {
-        switch (Root) {
-        case Dynamic: return L"Dynamic";
-        case ClassesRoot: return L"ClassesRoot";
-        case CurrentUser: return L"CurrentUser";
-        case LocalMachine: return L"LocalMachine";
-        case Users: return L"Users";
-        }
-        abort(); // should never be reached
-    }
-
-    std::wstring Registry;
-    RootType     Root;
-    std::wstring Key;
-    std::wstring Name;
-    std::wstring Value;
-    std::wstring Component_;
-};
-
-
-class FileTable {
-public:
-    /** https://docs.microsoft.com/en-us/windows/win32/msi/file-table */
-    struct Entry {
-        std::wstring File;
-        std::wstring Component_;
-        std::wstring FileName; ///< stored in "short-name|long-name" format if longer than 8+3
-        //std::wstring Filesize;
-        //...
-
-        std::wstring LongFileName() const {
-            // Doc: https://learn.microsoft.com/en-us/windows/win32/msi/filename
-            size_t idx = FileName.find(L'|');
-            if (idx == std::wstring::npos)
-                return FileName; // filename 8+3 or shorter
-
-            return FileName.substr(idx + 1); // remove short-name prefix
-        }
-
-        bool operator < (const Entry& other) const {
-            return File < other.File;
-        }
-    };
-
-    FileTable(std::vector<Entry> files) : m_files(files) {
-        // sort by "File" field
-        std::sort(m_files.begin(), m_files.end());
-    }
-
-    Entry Lookup(std::wstring File, bool throw_on_failure) {
-        // search for matching component
-        const Entry val = CreateFileEntry(File);
-        auto res = std::lower_bound(m_files.begin(), m_files.end(), val);
-        if ((res == m_files.end()) || (val < *res)) {
-            if (throw_on_failure)
-                throw std::runtime_error("Unable to find FileTable entry");
-            else
-                return {};
-        }
-
-        return *res;
-    }
-
-    const std::vector<Entry>& Entries() {
-        return m_files;
-    }
-
-private:
-    static Entry CreateFileEntry(std::wstring File) {
-        Entry entry;
-        entry.File = File;
-        return entry;
-    }
-
-    std::vector<Entry> m_files;
-};
-
-
-class DirectoryTable {
-public:
-    struct Entry {
-        std::wstring Directory;
-        std::wstring Directory_Parent;
-        std::wstring DefaultDir; ///< stored in "short-name|long-name" format if long
-
-        std::wstring LongDefaultDir() const {
-            size_t idx = DefaultDir.find(L'|');
-            if (idx == std::wstring::npos)
-                return DefaultDir; // only short name
-
-            return DefaultDir.substr(idx + 1); // remove short-name prefix
-        }
-
-        bool operator < (const Entry& other) const {
-            return Directory < other.Directory;
-        }
-    };
-
-    DirectoryTable(std::vector<Entry> directories) : m_directories(directories) {
-        // sort by "Directory" field
-        std::sort(m_directories.begin(), m_directories.end());
-    }
-
-    std::wstring Lookup(std::wstring Directory) const {
-        if (Directory.empty())
-            return L"";
-
-        const Entry val = CreateDirectoryEntry(Directory);
-        auto res = std::lower_bound(m_directories.begin(), m_directories.end(), val);
-        if (res == m_directories.end())
-            throw std::runtime_error("Unable to find DirectoryTable entry");
-        if (val < *res)
-            throw std::runtime_error("Unable to find DirectoryTable entry");
-
-        // recursive lookup
-        return Lookup(res->Directory_Parent) + L'\\' + res->LongDefaultDir();
-    }
-
-private:
-    static Entry CreateDirectoryEntry(std::wstring Directory) {
-        Entry entry;
-        entry.Directory = Directory;
-        return entry;
-    }
-
-    std::vector<Entry> m_directories;
-};
-
-
-
-class ComponentTable {
-public:
-    /** https://docs.microsoft.com/en-us/windows/win32/msi/component-table */
-    struct Entry {
-        std::wstring Component;
-        std::wstring ComponentId;
-        std::wstring Directory_;
-        int          Attributes; ///< 0x100=64bit, 0x004=RegistryKeyPath
-        //std::wstring Condition;
-        //std::wstring KeyPath;
-
-        bool operator < (const Entry& other) const {
-            return Component < other.Component;
-        }
-    };
-
-    ComponentTable(std::vector<Entry> components) : m_components(components) {
-        // sort by "Component" field
-        std::sort(m_components.begin(), m_components.end());
-    }
-
-    Entry Lookup(std::wstring Component) const {
-        // search for matching component
-        const Entry val = CreateComponentEntry(Component);
-        auto res = std::lower_bound(m_components.begin(), m_components.end(), val);
-        if (res == m_components.end())
-            throw std::runtime_error("Unable to find ComponentTable entry");
-        if (val < *res)
-            throw std::runtime_error("Unable to find ComponentTable entry");
-
-        return *res;
-    }
-
-private:
-    static Entry CreateComponentEntry(std::wstring Component) {
-        Entry entry;
-        entry.Component = Component;
-        return entry;
-    }
-
-    std::vector<Entry> m_components;
-};
+#include "MsiTables.hpp"
 
 
 /** Query an MSI file. It doesn't need to be installed first.
@@ -312,7 +19,7 @@ public:
         // open MSI DB
         UINT ret = MsiOpenDatabaseW(msi_path.c_str(), MSIDBOPEN_READONLY, &m_db);
         if (ret != ERROR_SUCCESS)
-            abort();
+            throw std::runtime_error("MsiOpenDatabase failed");
     }
 
     ~MsiQuery() {
@@ -359,7 +66,9 @@ public:
                 abort();
 
             auto val1 = GetRecordString(msi_record, 1);
-            auto val2 = GetRecordString(msi_record, 2);
+            Guid val2;
+            std::wstring component_id = GetRecordString(msi_record, 2);
+            Guid::TryParse(component_id, val2); // malformed IDs are left null and reported by --validate
             auto val3 = GetRecordString(msi_record, 3);
             auto val4 = GetRecordInt(msi_record, 4);
             result.push_back({val1, val2, val3, val4});
@@ -371,7 +80,7 @@ public:
     /** Query File table. */
     FileTable QueryFile () {
         PMSIHANDLE msi_view;
-        Execute(L"SELECT `File`,`Component_`,`FileName` FROM `File`", &msi_view);
+        Execute(L"SELECT `File`,`Component_`,`FileName`,`FileSize`,`Sequence` FROM `File`", &msi_view);
 
         std::vector<FileTable::Entry> result;
         while (true) {
@@ -385,12 +94,106 @@ public:
             auto val1 = GetRecordString(msi_record, 1);
             auto val2 = GetRecordString(msi_record, 2);
             auto val3 = GetRecordString(msi_record, 3);
-            result.push_back({val1, val2, val3});
+            auto val4 = GetRecordInt(msi_record, 4);
+            auto val5 = GetRecordInt(msi_record, 5);
+            result.push_back({val1, val2, val3, val4, val5});
         }
 
         return FileTable(result);
     }
 
+    /** Query MsiFileHash table. Only present for unversioned files. */
+    std::vector<FileHashEntry> QueryFileHash () {
+        PMSIHANDLE msi_view;
+        if (!Execute(L"SELECT `File_`,`Options`,`HashPart1`,`HashPart2`,`HashPart3`,`HashPart4` FROM `MsiFileHash`", &msi_view))
+            return {}; // table not found
+
+        std::vector<FileHashEntry> result;
+        while (true) {
+            PMSIHANDLE msi_record;
+            UINT ret = MsiViewFetch(msi_view, &msi_record);
+            if (ret == ERROR_NO_MORE_ITEMS)
+                break;
+            if (ret != ERROR_SUCCESS)
+                abort();
+
+            auto val1 = GetRecordString(msi_record, 1);
+            auto val2 = GetRecordInt(msi_record, 2);
+            auto val3 = GetRecordInt(msi_record, 3);
+            auto val4 = GetRecordInt(msi_record, 4);
+            auto val5 = GetRecordInt(msi_record, 5);
+            auto val6 = GetRecordInt(msi_record, 6);
+            result.push_back({val1, val2, val3, val4, val5, val6});
+        }
+
+        return result;
+    }
+
+    /** Query Media table. */
+    std::vector<MediaEntry> QueryMedia () {
+        PMSIHANDLE msi_view;
+        if (!Execute(L"SELECT `DiskId`,`LastSequence`,`Cabinet` FROM `Media`", &msi_view))
+            return {}; // table not found
+
+        std::vector<MediaEntry> result;
+        while (true) {
+            PMSIHANDLE msi_record;
+            UINT ret = MsiViewFetch(msi_view, &msi_record);
+            if (ret == ERROR_NO_MORE_ITEMS)
+                break;
+            if (ret != ERROR_SUCCESS)
+                abort();
+
+            auto val1 = GetRecordInt(msi_record, 1);
+            auto val2 = GetRecordInt(msi_record, 2);
+            auto val3 = GetRecordString(msi_record, 3);
+            result.push_back({val1, val2, val3});
+        }
+
+        return result;
+    }
+
+    /** Read an embedded stream, like a cabinet, from the _Streams table. Returns an empty buffer if not found. */
+    std::vector<char> ReadStream (const std::wstring& name) {
+        return ReadStream(name, [](size_t) {});
+    }
+
+    /** Read an embedded stream. The reserve(size) callback is invoked before the buffer is allocated, so that callers can limit memory usage. */
+    template <class Reserve>
+    std::vector<char> ReadStream (const std::wstring& name, Reserve reserve) {
+        PMSIHANDLE msi_view;
+        UINT ret = MsiDatabaseOpenViewW(m_db, L"SELECT `Data` FROM `_Streams` WHERE `Name`=?", &msi_view);
+        if (ret != ERROR_SUCCESS)
+            throw std::runtime_error("MsiDatabaseOpenView failed");
+
+        PMSIHANDLE param = MsiCreateRecord(1);
+        MsiRecordSetStringW(param, 1, name.c_str());
+        ret = MsiViewExecute(msi_view, param);
+        if (ret != ERROR_SUCCESS)
+            throw std::runtime_error("MsiViewExecute failed");
+
+        PMSIHANDLE msi_record;
+        ret = MsiViewFetch(msi_view, &msi_record);
+        if (ret == ERROR_NO_MORE_ITEMS)
+            return {}; // stream not found
+        if (ret != ERROR_SUCCESS)
+            throw std::runtime_error("MsiViewFetch failed");
+
+        const size_t size = MsiRecordDataSize(msi_record, 1);
+        reserve(size);
+        std::vector<char> buffer(size);
+        DWORD offset = 0;
+        while (offset < buffer.size()) {
+            DWORD buf_len = static_cast<DWORD>(buffer.size()) - offset;
+            ret = MsiRecordReadStream(msi_record, 1, buffer.data() + offset, &buf_len);
+            if ((ret != ERROR_SUCCESS) || (buf_len == 0))
+                throw std::runtime_error("MsiRecordReadStream failed");
+            offset += buf_len;
+        }
+
+        return buffer;
+    }
+
     /** Query Directory table. */
     DirectoryTable QueryDirectory() {
         PMSIHANDLE msi_view;
@@ -414,6 +217,29 @@ public:
         return DirectoryTable(result);
     }
 
+    /** Query Property table. */
+    PropertyTable QueryProperty () {
+        PMSIHANDLE msi_view;
+        if (!Execute(L"SELECT `Property`,`Value` FROM `Property`", &msi_view))
+            return PropertyTable({}); // table not found
+
+        std::vector<PropertyTable::Entry> result;
+        while (true) {
+            PMSIHANDLE msi_record;
+            UINT ret = MsiViewFetch(msi_view, &msi_record);
+            if (ret == ERROR_NO_MORE_ITEMS)
+                break;
+            if (ret != ERROR_SUCCESS)
+                abort();
+
+            auto val1 = GetRecordString(msi_record, 1);
+            auto val2 = GetRecordString(msi_record, 2);
+            result.push_back({val1, val2});
+        }
+
+        return PropertyTable(result);
+    }
+
     /** Query Registry table. */
     std::vector<RegEntry> QueryRegistry () {
         PMSIHANDLE msi_view;
@@ -468,6 +294,80 @@ public:
         return result;
     }
 
+    /** Names of all tables in the database. */
+    std::vector<std::wstring> QueryTableNames () {
+        PMSIHANDLE msi_view;
+        Execute(L"SELECT `Name` FROM `_Tables`", &msi_view);
+
+        std::vector<std::wstring> result;
+        while (true) {
+            PMSIHANDLE msi_record;
+            UINT ret = MsiViewFetch(msi_view, &msi_record);
+            if (ret == ERROR_NO_MORE_ITEMS)
+                break;
+            if (ret != ERROR_SUCCESS)
+                abort();
+
+            result.push_back(GetRecordString(msi_record, 1));
+        }
+
+        return result;
+    }
+
+    /** Query all columns of a table. Binary stream values are not read, but represented by a "[Binary]" placeholder. */
+    GenericTable QueryTable (const std::wstring& table) {
+        GenericTable result;
+        result.Name = table;
+
+        PMSIHANDLE msi_view;
+        if (!Execute(L"SELECT * FROM `" + table + L"`", &msi_view))
+            throw std::runtime_error("Table not found");
+
+        {
+            PMSIHANDLE names, types;
+            if ((MsiViewGetColumnInfo(msi_view, MSICOLINFO_NAMES, &names) != ERROR_SUCCESS) || (MsiViewGetColumnInfo(msi_view, MSICOLINFO_TYPES, &types) != ERROR_SUCCESS))
+                throw std::runtime_error("MsiViewGetColumnInfo failed");
+
+            UINT count = MsiRecordGetFieldCount(names);
+            for (UINT i = 1; i <= count; ++i) {
+                result.Columns.push_back(GetRecordString(names, i));
+                result.ColumnTypes.push_back(GetRecordString(types, i));
+            }
+        }
+        {
+            PMSIHANDLE keys;
+            if (MsiDatabaseGetPrimaryKeysW(m_db, table.c_str(), &keys) != ERROR_SUCCESS)
+                throw std::runtime_error("MsiDatabaseGetPrimaryKeys failed");
+
+            // field 0 contains the table name
+            UINT count = MsiRecordGetFieldCount(keys);
+            for (UINT i = 1; i <= count; ++i) {
+                int idx = result.ColumnIndex(GetRecordString(keys, i));
+                if (idx >= 0)
+                    result.KeyColumns.push_back(idx);
+            }
+        }
+
+        while (true) {
+            PMSIHANDLE msi_record;
+            UINT ret = MsiViewFetch(msi_view, &msi_record);
+            if (ret == ERROR_NO_MORE_ITEMS)
+                break;
+            if (ret != ERROR_SUCCESS)
+                abort();
+
+            for (UINT i = 1; i <= result.Columns.size(); ++i) {
+                wchar_t type = result.ColumnTypes[i - 1].empty() ? L's' : result.ColumnTypes[i - 1][0];
+                if ((type == L'v') || (type == L'V'))
+                    result.Cells.push_back(MsiRecordIsNull(msi_record, i) ? L"" : L"[Binary]");
+                else
+                    result.Cells.push_back(GetRecordString(msi_record, i));
+            }
+        }
+
+        return result;
+    }
+
 private:
     bool Execute (const std::wstring& sql_query, MSIHANDLE* view) {
         UINT ret = MsiDatabaseOpenViewW(m_db, sql_query.c_str(), view);
@@ -0,0 +1,507 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "CfbReader.hpp"
+#include "MsiTables.hpp"
+#include "TextConv.hpp"
+
+
+/** Name prefix of table streams. */
+static const char16_t MSI_TABLE_STREAM_PREFIX = 0x4840;
+
+/** Encode MSI stream name as stored in the CFB directory.
+    Pairs of [0-9A-Za-z._] characters are packed into a single code point, and table streams are prefixed with 0x4840.
+    Based on encode_streamname() in Wine dlls/msi/table.c */
+inline std::u16string EncodeMsiStreamName (const std::wstring& name, bool table) {
+    auto to_mime = [](wchar_t c) -> int {
+        if ((c >= L'0') && (c <= L'9'))
+            return c - L'0';
+        if ((c >= L'A') && (c <= L'Z'))
+            return c - L'A' + 10;
+        if ((c >= L'a') && (c <= L'z'))
+            return c - L'a' + 10 + 26;
+        if (c == L'.')
+            return 10 + 26 + 26;
+        if (c == L'_')
+            return 10 + 26 + 26 + 1;
+        return -1;
+    };
+
+    std::u16string result;
+    if (table)
+        result += MSI_TABLE_STREAM_PREFIX;
+
+    for (size_t i = 0; i < name.size(); ++i) {
+        int ch = to_mime(name[i]);
+        if (ch < 0) {
+            result += static_cast<char16_t>(name[i]);
+            continue;
+        }
+
+        int next = (i + 1 < name.size()) ? to_mime(name[i + 1]) : -1;
+        if (next >= 0) {
+            result += static_cast<char16_t>(0x3800 + ch + (next << 6));
+            ++i;
+        } else {
+            result += static_cast<char16_t>(0x4800 + ch);
+        }
+    }
+    return result;
+}
+
+
+/** Decode MSI stream name from the CFB directory. Reverse of EncodeMsiStreamName, except that the table prefix is dropped. */
+inline std::wstring DecodeMsiStreamName (const std::u16string& name) {
+    auto from_mime = [](int c) -> wchar_t {
+        if (c < 10)
+            return static_cast<wchar_t>(L'0' + c);
+        if (c < 10 + 26)
+            return static_cast<wchar_t>(L'A' + c - 10);
+        if (c < 10 + 26 + 26)
+            return static_cast<wchar_t>(L'a' + c - 10 - 26);
+        if (c == 10 + 26 + 26)
+            return L'.';
+        return L'_';
+    };
+
+    std::wstring result;
+    for (size_t i = 0; i < name.size(); ++i) {
+        int c = name[i];
+        if ((i == 0) && (c == MSI_TABLE_STREAM_PREFIX))
+            continue;
+
+        if ((c >= 0x3800) && (c < 0x4800)) {
+            result += from_mime((c - 0x3800) & 0x3F);
+            result += from_mime((c - 0x3800) >> 6);
+        } else if ((c >= 0x4800) && (c < 0x4840)) {
+            result += from_mime(c - 0x4800);
+        } else {
+            result += static_cast<wchar_t>(c);
+        }
+    }
+    return result;
+}
+
+
+/** String table of a MSI database, decoded from the _StringPool and _StringData streams.
+    Strings are kept in the database code page and only converted when accessed. */
+class MsiStringPool {
+public:
+    MsiStringPool(std::vector<uint8_t> pool, std::vector<uint8_t> data) : m_data(std::move(data)) {
+        if (pool.size() < 4)
+            throw std::runtime_error("Invalid _StringPool stream");
+
+        // first entry contains the code page and a flag for 3-byte string references
+        m_codepage = Read16(&pool[0]) | ((Read16(&pool[2]) & 0x7FFF) << 16);
+        m_ref_size = (Read16(&pool[2]) & 0x8000) ? 3 : 2;
+
+        m_strings.push_back({}); // ID 0 is the null string
+        size_t offset = 0;
+        const size_t count = pool.size() / 4;
+        for (size_t i = 1; i < count;) {
+            uint32_t len = Read16(&pool[4 * i]);
+            uint16_t refs = Read16(&pool[4 * i + 2]);
+            if ((len == 0) && (refs == 0)) {
+                m_strings.push_back({}); // unused ID
+                ++i;
+                continue;
+            }
+
+            if (len == 0) {
+                // strings over 64k have their length stored in the following entry
+                if (i + 1 >= count)
+                    throw std::runtime_error("Invalid _StringPool stream");
+                len = Read16(&pool[4 * i + 4]) | (static_cast<uint32_t>(Read16(&pool[4 * i + 6])) << 16);
+                i += 2;
+            } else {
+                i += 1;
+            }
+
+            if (offset + len > m_data.size())
+                throw std::runtime_error("Invalid _StringData stream");
+            m_strings.push_back(EncodedString(reinterpret_cast<const char*>(m_data.data()) + offset, len, m_codepage));
+            offset += len;
+        }
+        m_converted.resize(m_strings.size());
+        m_cache.resize(m_strings.size());
+    }
+
+    MsiStringPool(const MsiStringPool&) = delete;
+    MsiStringPool& operator = (const MsiStringPool&) = delete;
+
+    unsigned int CodePage() const {
+        return m_codepage;
+    }
+
+    /** Size of string references in table streams. */
+    size_t RefSize() const {
+        return m_ref_size;
+    }
+
+    /** Get string by ID. ID 0 is the null string. */
+    const std::wstring& Get(uint32_t id) const {
+        if (id >= m_strings.size())
+            throw std::runtime_error("Invalid string reference");
+
+        if (!m_converted[id]) {
+            m_cache[id] = m_strings[id].Wide();
+            m_converted[id] = true;
+        }
+        return m_cache[id];
+    }
+
+    /** Get unconverted string by ID. */
+    const EncodedString& Encoded(uint32_t id) const {
+        if (id >= m_strings.size())
+            throw std::runtime_error("Invalid string reference");
+        return m_strings[id];
+    }
+
+    /** Number of string IDs, including the null string. */
+    size_t Size() const {
+        return m_strings.size();
+    }
+
+private:
+    static uint16_t Read16(const uint8_t* ptr) {
+        return static_cast<uint16_t>(ptr[0] | (ptr[1] << 8));
+    }
+
+    unsigned int               m_codepage = 0;
+    size_t                     m_ref_size = 2;
+    std::vector<uint8_t>       m_data;
+    std::vector<EncodedString> m_strings;   ///< views into m_data
+    mutable std::vector<bool>         m_converted;
+    mutable std::vector<std::wstring> m_cache;
+};
+
+
+/** Read-only view of a MSI table stream. Rows are stored column-by-column.
+    REF: https://learn.microsoft.com/en-us/windows/win32/msi/column-definition-format */
+class MsiStreamTable {
+public:
+    struct Column {
+        std::wstring Name;
+        int          Type = 0;   ///< column type bits from the _Columns table
+        size_t       Width = 0;  ///< bytes per row
+        size_t       Offset = 0; ///< start of column data in stream
+    };
+
+    MsiStreamTable(const MsiStringPool& strings, std::vector<Column> columns, const std::vector<uint8_t>* data) : m_strings(strings), m_columns(std::move(columns)), m_data(data) {
+        size_t row_size = 0;
+        for (Column& column : m_columns) {
+            column.Width = ColumnWidth(column.Type, m_strings.RefSize());
+            row_size += column.Width;
+        }
+        m_rows = (m_data && row_size) ? m_data->size() / row_size : 0;
+
+        size_t offset = 0;
+        for (Column& column : m_columns) {
+            column.Offset = offset;
+            offset += column.Width * m_rows;
+        }
+    }
+
+    size_t Rows() const {
+        return m_rows;
+    }
+
+    const std::vector<Column>& Columns() const {
+        return m_columns;
+    }
+
+    /** Get column index by name. */
+    size_t ColumnIndex(const wchar_t* name) const {
+        for (size_t i = 0; i < m_columns.size(); ++i) {
+            if (m_columns[i].Name == name)
+                return i;
+        }
+        throw std::runtime_error("Column not found");
+    }
+
+    /** Raw stored value. 0 is NULL for all column types. */
+    uint32_t GetRaw(size_t row, size_t col) const {
+        const Column& column = m_columns[col];
+        const uint8_t* ptr = m_data->data() + column.Offset + row * column.Width;
+        uint32_t val = 0;
+        for (size_t i = 0; i < column.Width; ++i)
+            val |= static_cast<uint32_t>(ptr[i]) << (8 * i);
+        return val;
+    }
+
+    std::wstring GetString(size_t row, size_t col) const {
+        return m_strings.Get(GetRaw(row, col));
+    }
+
+    /** Integers are stored with an offset of 0x8000 or 0x80000000, so that 0 represents NULL. */
+    int GetInt(size_t row, size_t col) const {
+        uint32_t raw = GetRaw(row, col);
+        if (raw == 0)
+            throw std::runtime_error("NULL integer column");
+        if (m_columns[col].Width == 2)
+            return static_cast<int>(raw) - 0x8000;
+        return static_cast<int>(raw ^ 0x80000000);
+    }
+
+    /** Column storage size. Binary columns are stored as 2 byte references to separate streams. */
+    static size_t ColumnWidth(int type, size_t ref_size) {
+        if ((type & ~MSITYPE_NULLABLE) == (MSITYPE_STRING | MSITYPE_VALID))
+            return 2; // binary
+        if (type & MSITYPE_STRING)
+            return ref_size;
+        if ((type & 0xFF) <= 2)
+            return 2;
+        return 4;
+    }
+
+    static const int MSITYPE_VALID = 0x0100;
+    static const int MSITYPE_STRING = 0x0800;
+    static const int MSITYPE_NULLABLE = 0x1000;
+
+private:
+    const MsiStringPool&        m_strings;
+    std::vector<Column>         m_columns;
+    const std::vector<uint8_t>* m_data = nullptr; ///< nullptr for empty tables
+    size_t                      m_rows = 0;
+};
+
+
+/** Query an MSI file from non-seekable input, like stdin or a pipe, by decoding the table streams directly.
+    Provides the same Query methods as MsiQuery, but doesn't require a file path or the Windows Installer API.
+    All streams needed by the Query methods are read in a single forward pass when constructed. */
+class MsiStreamQuery {
+public:
+    MsiStreamQuery (FILE* input, size_t cache_budget = 256u << 20, bool all_tables = false) {
+        static const wchar_t* TABLES[] = {L"_StringPool", L"_StringData", L"_Tables", L"_Columns",
+            L"Feature", L"Component", L"File", L"MsiFileHash", L"Media", L"Directory", L"Property", L"Registry", L"CustomAction"};
+
+        std::vector<std::u16string> encoded;
+        for (const wchar_t* table : TABLES)
+            encoded.push_back(EncodeMsiStreamName(table, true));
+
+        CfbStreamReader reader(input, cache_budget);
+        auto filter = [&](const std::u16string& name) {
+            if (all_tables)
+                return !name.empty() && (name[0] == MSI_TABLE_STREAM_PREFIX);
+            return std::find(encoded.begin(), encoded.end(), name) != encoded.end();
+        };
+        for (auto& stream : reader.ReadStreams(filter))
+            m_streams[DecodeMsiStreamName(stream.first)] = std::move(stream.second);
+
+        m_strings.reset(new MsiStringPool(std::move(m_streams[L"_StringPool"]), std::move(m_streams[L"_StringData"])));
+        LoadSchema();
+    }
+
+    /** Names of all tables listed in _Tables. */
+    std::vector<std::wstring> TableNames() const {
+        std::vector<std::wstring> result;
+        for (auto& table : m_columns)
+            result.push_back(table.first);
+        return result;
+    }
+
+    /** Get table by name. Missing tables are returned as empty unless "required" is set.
+        Only the tables used by the Query methods are available unless constructed with "all_tables". */
+    MsiStreamTable Table(const std::wstring& name, bool required = false) const {
+        auto it = m_columns.find(name);
+        if (it == m_columns.end()) {
+            if (required)
+                throw std::runtime_error("Table not found");
+            return MsiStreamTable(*m_strings, {}, nullptr);
+        }
+        return MsiStreamTable(*m_strings, it->second, Stream(name));
+    }
+
+    const MsiStringPool& Strings() const {
+        return *m_strings;
+    }
+
+    std::vector<FeatureEntry> QueryFeature() {
+        MsiStreamTable table = Table(L"Feature", true);
+        const size_t c1 = table.ColumnIndex(L"Feature"), c2 = table.ColumnIndex(L"Title"), c3 = table.ColumnIndex(L"Description");
+        const size_t c4 = table.ColumnIndex(L"Display"), c5 = table.ColumnIndex(L"Level"), c6 = table.ColumnIndex(L"Attributes");
+
+        std::vector<FeatureEntry> result;
+        for (size_t row = 0; row < table.Rows(); ++row) {
+            FeatureEntry entry;
+            entry.Feature = table.GetString(row, c1);
+            entry.Title = table.GetString(row, c2);
+            entry.Description = table.GetString(row, c3);
+            entry.Display = table.GetInt(row, c4);
+            entry.Level = table.GetInt(row, c5);
+            entry.Attributes = table.GetInt(row, c6);
+            result.push_back(entry);
+        }
+
+        return result;
+    }
+
+    /** Query Component table. */
+    ComponentTable QueryComponent () {
+        MsiStreamTable table = Table(L"Component", true);
+        const size_t c1 = table.ColumnIndex(L"Component"), c2 = table.ColumnIndex(L"ComponentId"), c3 = table.ColumnIndex(L"Directory_"), c4 = table.ColumnIndex(L"Attributes");
+
+        std::vector<ComponentTable::Entry> result;
+        for (size_t row = 0; row < table.Rows(); ++row) {
+            auto val1 = table.GetString(row, c1);
+            Guid val2;
+            std::wstring component_id = table.GetString(row, c2);
+            Guid::TryParse(component_id, val2); // malformed IDs are left null and reported by --validate
+            auto val3 = table.GetString(row, c3);
+            auto val4 = table.GetInt(row, c4);
+            result.push_back({val1, val2, val3, val4});
+        }
+
+        return ComponentTable(result);
+    }
+
+    /** Query File table. */
+    FileTable QueryFile () {
+        MsiStreamTable table = Table(L"File", true);
+        const size_t c1 = table.ColumnIndex(L"File"), c2 = table.ColumnIndex(L"Component_"), c3 = table.ColumnIndex(L"FileName"), c4 = table.ColumnIndex(L"FileSize"), c5 = table.ColumnIndex(L"Sequence");
+
+        std::vector<FileTable::Entry> result;
+        for (size_t row = 0; row < table.Rows(); ++row)
+            result.push_back({table.GetString(row, c1), table.GetString(row, c2), table.GetString(row, c3), table.GetInt(row, c4), table.GetInt(row, c5)});
+
+        return FileTable(result);
+    }
+
+    /** Query MsiFileHash table. Only present for unversioned files. */
+    std::vector<FileHashEntry> QueryFileHash () {
+        MsiStreamTable table = Table(L"MsiFileHash", false);
+        if (!table.Rows())
+            return {}; // table not found
+        const size_t c1 = table.ColumnIndex(L"File_"), c2 = table.ColumnIndex(L"Options");
+        const size_t c3 = table.ColumnIndex(L"HashPart1"), c4 = table.ColumnIndex(L"HashPart2"), c5 = table.ColumnIndex(L"HashPart3"), c6 = table.ColumnIndex(L"HashPart4");
+
+        std::vector<FileHashEntry> result;
+        for (size_t row = 0; row < table.Rows(); ++row)
+            result.push_back({table.GetString(row, c1), table.GetInt(row, c2), table.GetInt(row, c3), table.GetInt(row, c4), table.GetInt(row, c5), table.GetInt(row, c6)});
+
+        return result;
+    }
+
+    /** Query Media table. */
+    std::vector<MediaEntry> QueryMedia () {
+        MsiStreamTable table = Table(L"Media", false);
+        if (!table.Rows())
+            return {}; // table not found
+        const size_t c1 = table.ColumnIndex(L"DiskId"), c2 = table.ColumnIndex(L"LastSequence"), c3 = table.ColumnIndex(L"Cabinet");
+
+        std::vector<MediaEntry> result;
+        for (size_t row = 0; row < table.Rows(); ++row)
+            result.push_back({table.GetInt(row, c1), table.GetInt(row, c2), table.GetString(row, c3)});
+
+        return result;
+    }
+
+    /** Query Directory table. */
+    DirectoryTable QueryDirectory() {
+        MsiStreamTable table = Table(L"Directory", true);
+        const size_t c1 = table.ColumnIndex(L"Directory"), c2 = table.ColumnIndex(L"Directory_Parent"), c3 = table.ColumnIndex(L"DefaultDir");
+
+        std::vector<DirectoryTable::Entry> result;
+        for (size_t row = 0; row < table.Rows(); ++row)
+            result.push_back({table.GetString(row, c1), table.GetString(row, c2), table.GetString(row, c3)});
+
+        return DirectoryTable(result);
+    }
+
+    /** Query Property table. */
+    PropertyTable QueryProperty () {
+        MsiStreamTable table = Table(L"Property", false);
+        if (!table.Rows())
+            return PropertyTable({}); // table not found
+        const size_t c1 = table.ColumnIndex(L"Property"), c2 = table.ColumnIndex(L"Value");
+
+        std::vector<PropertyTable::Entry> result;
+        for (size_t row = 0; row < table.Rows(); ++row)
+            result.push_back({table.GetString(row, c1), table.GetString(row, c2)});
+
+        return PropertyTable(result);
+    }
+
+    /** Query Registry table. */
+    std::vector<RegEntry> QueryRegistry () {
+        MsiStreamTable table = Table(L"Registry", false);
+        if (!table.Rows())
+            return {}; // table not found
+        const size_t c1 = table.ColumnIndex(L"Registry"), c2 = table.ColumnIndex(L"Root"), c3 = table.ColumnIndex(L"Key");
+        const size_t c4 = table.ColumnIndex(L"Name"), c5 = table.ColumnIndex(L"Value"), c6 = table.ColumnIndex(L"Component_");
+
+        std::vector<RegEntry> result;
+        for (size_t row = 0; row < table.Rows(); ++row) {
+            auto val2 = static_cast<RegEntry::RootType>(table.GetInt(row, c2));
+            result.push_back({table.GetString(row, c1), val2, table.GetString(row, c3), table.GetString(row, c4), table.GetString(row, c5), table.GetString(row, c6)});
+        }
+
+        return result;
+    }
+
+    /** Query CustomAction table. */
+    std::vector<CustomActionEntry> QueryCustomAction () {
+        MsiStreamTable table = Table(L"CustomAction", false);
+        if (!table.Rows())
+            return {};
+        const size_t c1 = table.ColumnIndex(L"Action"), c2 = table.ColumnIndex(L"Type"), c3 = table.ColumnIndex(L"Source"), c4 = table.ColumnIndex(L"Target");
+
+        std::vector<CustomActionEntry> result;
+        for (size_t row = 0; row < table.Rows(); ++row) {
+            // ExtendedType column is only present in newer schemas
+            std::wstring extended_type;
+            const auto& columns = table.Columns();
+            for (size_t c5 = 0; c5 < columns.size(); ++c5) {
+                if ((columns[c5].Name == L"ExtendedType") && table.GetRaw(row, c5))
+                    extended_type = std::to_wstring(table.GetInt(row, c5));
+            }
+            result.push_back({table.GetString(row, c1), table.GetInt(row, c2), table.GetString(row, c3), table.GetString(row, c4), extended_type});
+        }
+
+        return result;
+    }
+
+private:
+    /** Parse _Tables and _Columns system tables. */
+    void LoadSchema() {
+        const int INT16 = 2;
+        const int STRING = MsiStreamTable::MSITYPE_STRING | MsiStreamTable::MSITYPE_VALID | 64; // non-zero length, so that 3-byte string references are used for large string pools
+
+        MsiStreamTable tables(*m_strings, {{L"Name", STRING}}, Stream(L"_Tables"));
+        for (size_t row = 0; row < tables.Rows(); ++row)
+            m_columns[tables.GetString(row, 0)]; // tables without columns are still listed
+
+        MsiStreamTable columns(*m_strings, {{L"Table", STRING}, {L"Number", INT16}, {L"Name", STRING}, {L"Type", INT16}}, Stream(L"_Columns"));
+        std::map<std::wstring, std::map<int, MsiStreamTable::Column>> ordered;
+        for (size_t row = 0; row < columns.Rows(); ++row) {
+            MsiStreamTable::Column column;
+            column.Name = columns.GetString(row, 2);
+            column.Type = columns.GetInt(row, 3);
+            ordered[columns.GetString(row, 0)][columns.GetInt(row, 1)] = column;
+        }
+
+        for (auto& table : ordered) {
+            std::vector<MsiStreamTable::Column>& dst = m_columns[table.first];
+            for (auto& column : table.second)
+                dst.push_back(column.second);
+        }
+    }
+
+    /** Get table stream. Returns nullptr if not present, which is the case for empty tables. */
+    const std::vector<uint8_t>* Stream(const std::wstring& name) const {
+        auto it = m_streams.find(name);
+        if (it == m_streams.end())
+            return nullptr;
+        return &it->second;
+    }
+
+    std::map<std::wstring, std::vector<uint8_t>>                m_streams; ///< table name to stream content
+    std::unique_ptr<MsiStringPool>                              m_strings;
+    std::map<std::wstring, std::vector<MsiStreamTable::Column>> m_columns; ///< table name to ordered columns
+};
@@ -0,0 +1,411 @@
+#pragma once
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Guid.hpp"
+
+
+/** https://learn.microsoft.com/en-us/windows/win32/msi/feature-table */
+struct FeatureEntry {
+    std::wstring Feature;     ///< feature identifier [max 38 chars]
+    //std::wstring Feature_Parent;
+    std::wstring Title;       ///< short description
+    std::wstring Description; ///< longer description [localizable]
+    int Display = 0;          ///< UI order
+    int Level = 0;            ///< 0=disables installation
+    //std::wstring Directory_;
+    int Attributes = 0;
+
+    std::wstring ToString() const {
+        return L"Title=" + Title + L", Description=" + Description + L", Feature=" + Feature;
+    }
+};
+
+
+/** https://docs.microsoft.com/en-us/windows/win32/msi/customaction-table */
+struct CustomActionEntry {
+    /** CustomAction type parser.
+    *   Based on msidbCustomActionType enum in <msidefs.h>
+    *   REF: https://docs.microsoft.com/en-us/windows/win32/msi/summary-list-of-all-custom-action-types
+    *
+    *   Wix custom actions:
+    *    Type 65   (0x041)  =                                                                Continue(0x40)                    + Dll(0x01) // ValidatePath, PrintEula
+    *   Custom DLL:
+    *    Type               =                                                                                                  + Dll(0x01) // Type 1/17 run DLL
+    *   Custom EXE:
+    *    Type 3106 (0x0C22) =                       NoImpersonate(0x800) + Deferred(0x400)                  + Directory(0x20)  + Exe(0x02) // Type 2/18/34/50 run executable
+    *    Type 3170 (0x0C62) =                       NoImpersonate(0x800) + Deferred(0x400) + Continue(0x40) + Directory(0x20)  + Exe(0x02)
+    *   Custom JScript:
+    *    Type 7189 (0x1C15) = Script64Bit(0x1000) + NoImpersonate(0x800) + Deferred(0x400) +                  SourceFile(0x10) + Script(0x04) + Dll(0x01) // Type 5/21/37/53 JScript
+    *    Type 7253 (0x1C55) = Script64Bit(0x1000) + NoImpersonate(0x800) + Deferred(0x400) + Continue(0x40) + SourceFile(0x10) + Script(0x04) + Dll(0x01)
+    *   Custom VBScript:
+    *    Type               =                                                                                                  + Script(0x04) + Exe(0x02) // Type 6/22/38/54 VBScript
+    */
+    struct Type {
+        Type() {
+            memset(this, 0, sizeof(Type)); // replace with default member initializers after upgrading to newer C++ version
+        }
+
+        /** Parse MSI CustomAction "Type" column. */
+        Type(int val) {
+            (int&)(*this) = val;
+        }
+
+        std::wstring ToString() const {
+            std::wstring res = L"[";
+            if (Dll) res += L"Dll,";
+            if (Exe) res += L"Exe,";
+            if (Script) res += L"Script,";
+            if (SourceFile) res += L"SourceFile,";
+            if (Directory) res += L"Directory,";
+            if (Continue) res += L"Continue,";
+            if (Async) res += L"Async,";
+            if (Rollback) res += L"Rollback,";
+            if (Commit) res += L"Commit,";
+            if (Deferred) res += L"Deferred,";
+            if (NoImpersonate) res += L"NoImpersonate,";
+            if (Script64Bit) res += L"Script64Bit,";
+            if (HideTarget) res += L"HideTarget,";
+            if (TSAware) res += L"TSAware,";
+            if (PatchUninstall) res += L"PatchUninstall,";
+            return res.substr(0, res.size() - 1) + L"]";
+        }
+
+        operator int& () {
+            return *reinterpret_cast<int*>(this);
+        }
+        operator const int& () const {
+            return *reinterpret_cast<const int*>(this);
+        }
+
+        /** Special combinations:
+        *   msidbCustomActionTypeTextData (0x03) = Dll | Exe
+        *   msidbCustomActionTypeJScript (0x05) = 0x04 | Dll
+        *   msidbCustomActionTypeVBScript (0x06) = 0x04 | Dll
+        *   msidbCustomActionTypeInstall (0x07) = 0x04 | Exe | Dll
+        *   msidbCustomActionTypeProperty (0x30) = Directory | File
+        *   msidbCustomActionTypeClientRepeat (0x300) = FirstSequence + OncePerProcess */
+        bool Dll : 1; ///< msidbCustomActionTypeDll (0x01)
+        bool Exe : 1; ///< msidbCustomActionTypeExe (0x02)
+        bool Script : 1; ///< script (used by msidbCustomActionTypeJScript (0x05) and msidbCustomActionTypeVBScript (0x06))
+        bool _padding1 : 1;
+        bool SourceFile : 1; ///< msidbCustomActionTypeSourceFile (0x10)
+        bool Directory : 1; ///< msidbCustomActionTypeDirectory (0x20)
+        bool Continue : 1; ///< msidbCustomActionTypeContinue (0x40)
+        bool Async : 1; ///< msidbCustomActionTypeAsync (0x80)
+        bool Rollback : 1; ///< msidbCustomActionTypeFirstSequence or msidbCustomActionTypeRollback (0x100)
+        bool Commit : 1; ///< msidbCustomActionTypeOncePerProcess or msidbCustomActionTypeCommit (0x200)
+        bool Deferred : 1; ///< msidbCustomActionTypeInScript (0x400) (deferred execution)
+        bool NoImpersonate : 1; ///< msidbCustomActionTypeNoImpersonate (0x800) - run as ADMIN
+        bool Script64Bit : 1; ///< msidbCustomActionType64BitScript (0x1000)
+        bool HideTarget : 1; ///< msidbCustomActionTypeHideTarget (0x2000)
+        bool TSAware : 1; ///< msidbCustomActionTypeTSAware (0x4000) (Terminal Server)
+        bool PatchUninstall : 1; ///< msidbCustomActionTypePatchUninstall (0x8000)
+        bool _padding2 : 8;
+        bool _padding3 : 8;
+    };
+    static_assert(sizeof(Type) == sizeof(int), "CustomAction::Type size mismatch");
+
+
+    std::wstring Action;
+    Type         Type;
+    std::wstring Source;
+    std::wstring Target;
+    std::wstring ExtendedType;
+};
+
+
+/** https://docs.microsoft.com/en-us/windows/win32/msi/registry-table */
+struct RegEntry {
+    enum RootType : int {
+        Dynamic      = -1,// HKEY_CURRENT_USER or HKEY_LOCAL_MACHINE, depending on ALLUSERS
+        ClassesRoot  = 0, // HKEY_CLASSES_ROOT
+        CurrentUser  = 1, // HKEY_CURRENT_USER
+        LocalMachine = 2, // HKEY_LOCAL_MACHINE
+        Users        = 3, // HKEY_USERS
+    };
+
+    std::wstring RootStr () const {
+        switch (Root) {
+        case Dynamic: return L"Dynamic";
+        case ClassesRoot: return L"ClassesRoot";
+        case CurrentUser: return L"CurrentUser";
+        case LocalMachine: return L"LocalMachine";
+        case Users: return L"Users";
+        }
+        abort(); // should never be reached
+    }
+
+    std::wstring Registry;
+    RootType     Root;
+    std::wstring Key;
+    std::wstring Name;
+    std::wstring Value;
+    std::wstring Component_;
+};
+
+
+/** https://learn.microsoft.com/en-us/windows/win32/msi/msifilehash-table */
+struct FileHashEntry {
+    std::wstring File_;
+    int          Options;
+    int          HashPart1; ///< 128bit MD5 hash split into 4 parts (same layout as MSIFILEHASHINFO)
+    int          HashPart2;
+    int          HashPart3;
+    int          HashPart4;
+};
+
+
+/** https://learn.microsoft.com/en-us/windows/win32/msi/media-table */
+struct MediaEntry {
+    int          DiskId;
+    int          LastSequence;
+    std::wstring Cabinet; ///< "#" prefix for cabinets embedded as stream in the MSI file
+};
+
+
+class FileTable {
+public:
+    /** https://docs.microsoft.com/en-us/windows/win32/msi/file-table */
+    struct Entry {
+        std::wstring File;
+        std::wstring Component_;
+        std::wstring FileName; ///< stored in "short-name|long-name" format if longer than 8+3
+        int          FileSize = 0;
+        int          Sequence = 0; ///< position in cabinet, mapped to Media through LastSequence
+        //...
+
+        std::wstring LongFileName() const {
+            // Doc: https://learn.microsoft.com/en-us/windows/win32/msi/filename
+            size_t idx = FileName.find(L'|');
+            if (idx == std::wstring::npos)
+                return FileName; // filename 8+3 or shorter
+
+            return FileName.substr(idx + 1); // remove short-name prefix
+        }
+
+        bool operator < (const Entry& other) const {
+            return File < other.File;
+        }
+    };
+
+    FileTable(std::vector<Entry> files) : m_files(files) {
+        // sort by "File" field
+        std::sort(m_files.begin(), m_files.end());
+    }
+
+    Entry Lookup(std::wstring File, bool throw_on_failure) const {
+        // search for matching component
+        const Entry val = CreateFileEntry(File);
+        auto res = std::lower_bound(m_files.begin(), m_files.end(), val);
+        if ((res == m_files.end()) || (val < *res)) {
+            if (throw_on_failure)
+                throw std::runtime_error("Unable to find FileTable entry");
+            else
+                return {};
+        }
+
+        return *res;
+    }
+
+    const std::vector<Entry>& Entries() const {
+        return m_files;
+    }
+
+private:
+    static Entry CreateFileEntry(std::wstring File) {
+        Entry entry;
+        entry.File = File;
+        return entry;
+    }
+
+    std::vector<Entry> m_files;
+};
+
+
+class DirectoryTable {
+public:
+    struct Entry {
+        std::wstring Directory;
+        std::wstring Directory_Parent;
+        std::wstring DefaultDir; ///< stored in "short-name|long-name" format if long
+
+        std::wstring LongDefaultDir() const {
+            size_t idx = DefaultDir.find(L'|');
+            if (idx == std::wstring::npos)
+                return DefaultDir; // only short name
+
+            return DefaultDir.substr(idx + 1); // remove short-name prefix
+        }
+
+        bool operator < (const Entry& other) const {
+            return Directory < other.Directory;
+        }
+    };
+
+    DirectoryTable(std::vector<Entry> directories) : m_directories(directories) {
+        // sort by "Directory" field
+        std::sort(m_directories.begin(), m_directories.end());
+    }
+
+    std::wstring Lookup(std::wstring Directory) const {
+        if (Directory.empty())
+            return L"";
+
+        const Entry* res = Find(Directory);
+        if (!res)
+            throw std::runtime_error("Unable to find DirectoryTable entry");
+
+        // recursive lookup
+        return Lookup(res->Directory_Parent) + L'\\' + res->LongDefaultDir();
+    }
+
+    /** Non-throwing lookup. Returns nullptr if not found. */
+    const Entry* Find(const std::wstring& Directory) const {
+        const Entry val = CreateDirectoryEntry(Directory);
+        auto res = std::lower_bound(m_directories.begin(), m_directories.end(), val);
+        if ((res == m_directories.end()) || (val < *res))
+            return nullptr;
+
+        return &*res;
+    }
+
+private:
+    static Entry CreateDirectoryEntry(std::wstring Directory) {
+        Entry entry;
+        entry.Directory = Directory;
+        return entry;
+    }
+
+    std::vector<Entry> m_directories;
+};
+
+
+
+class ComponentTable {
+public:
+    /** https://docs.microsoft.com/en-us/windows/win32/msi/component-table */
+    struct Entry {
+        std::wstring Component;
+        Guid         ComponentId; ///< null for unregistered components
+        std::wstring Directory_;
+        int          Attributes; ///< 0x100=64bit, 0x004=RegistryKeyPath
+        //std::wstring Condition;
+        //std::wstring KeyPath;
+
+        bool operator < (const Entry& other) const {
+            return Component < other.Component;
+        }
+    };
+
+    ComponentTable(std::vector<Entry> components) : m_components(components) {
+        // sort by "Component" field
+        std::sort(m_components.begin(), m_components.end());
+    }
+
+    Entry Lookup(std::wstring Component) const {
+        const Entry* res = Find(Component);
+        if (!res)
+            throw std::runtime_error("Unable to find ComponentTable entry");
+
+        return *res;
+    }
+
+    /** Non-throwing lookup. Returns nullptr if not found. */
+    const Entry* Find(const std::wstring& Component) const {
+        // search for matching component
+        const Entry val = CreateComponentEntry(Component);
+        auto res = std::lower_bound(m_components.begin(), m_components.end(), val);
+        if ((res == m_components.end()) || (val < *res))
+            return nullptr;
+
+        return &*res;
+    }
+
+    const std::vector<Entry>& Entries() const {
+        return m_components;
+    }
+
+private:
+    static Entry CreateComponentEntry(std::wstring Component) {
+        Entry entry;
+        entry.Component = Component;
+        return entry;
+    }
+
+    std::vector<Entry> m_components;
+};
+
+
+class PropertyTable {
+public:
+    /** https://learn.microsoft.com/en-us/windows/win32/msi/property-table */
+    struct Entry {
+        std::wstring Property;
+        std::wstring Value;
+
+        bool operator < (const Entry& other) const {
+            return Property < other.Property;
+        }
+    };
+
+    PropertyTable(std::vector<Entry> properties) : m_properties(properties) {
+        // sort by "Property" field
+        std::sort(m_properties.begin(), m_properties.end());
+    }
+
+    /** Non-throwing lookup. Returns nullptr if not found. */
+    const std::wstring* Find(const std::wstring& Property) const {
+        Entry val;
+        val.Property = Property;
+        auto res = std::lower_bound(m_properties.begin(), m_properties.end(), val);
+        if ((res == m_properties.end()) || (val < *res))
+            return nullptr;
+
+        return &res->Value;
+    }
+
+private:
+    std::vector<Entry> m_properties;
+};
+
+
+/** Contents of an arbitrary table with all values converted to strings.
+    NULL values are stored as empty strings, which MSI treats as equivalent for string columns. */
+struct GenericTable {
+    std::wstring              Name;
+    std::vector<std::wstring> Columns;
+    std::vector<std::wstring> ColumnTypes; ///< column definition like "s72", "i2" or "v0" (uppercase for nullable columns)
+    std::vector<size_t>       KeyColumns;  ///< primary key column indices
+    std::vector<std::wstring> Cells;       ///< values stored row-by-row
+
+    size_t Rows() const {
+        return Columns.empty() ? 0 : Cells.size() / Columns.size();
+    }
+
+    const std::wstring& Get(size_t row, size_t col) const {
+        return Cells[row * Columns.size() + col];
+    }
+
+    /** Get column index by name. Returns -1 if not found. */
+    int ColumnIndex(const std::wstring& name) const {
+        auto it = std::find(Columns.begin(), Columns.end(), name);
+        if (it == Columns.end())
+            return -1;
+        return static_cast<int>(it - Columns.begin());
+    }
+
+    /** Primary key values of a row, separated by '/'. */
+    std::wstring RowKey(size_t row) const {
+        std::wstring result;
+        for (size_t col : KeyColumns) {
+            if (!result.empty())
+                result += L'/';
+            result += Get(row, col);
+        }
+        return result;
+    }
+};
@@ -2,23 +2,67 @@
 #include <cassert>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 #include <Windows.h>
 #include <msi.h>
+#include "Guid.hpp"
+#include "TextConv.hpp"
 
 
-/** Converts ASCII string to unicode */
-inline std::wstring ToUnicode(const std::string& s_str) {
-#ifdef _MSC_VER
-#pragma warning(push)
-#pragma warning(disable: 4996) // function or variable may be unsafe
-#endif
-    std::wstring w_str(s_str.size(), L'\0');
-    mbstowcs(const_cast<wchar_t*>(w_str.data()), s_str.c_str(), w_str.size());
-#ifdef _MSC_VER
-#pragma warning(pop)
-#endif
-    return w_str;
+/** Convert relative path to absolute path. */
+static std::wstring ToAbsolutePath(std::wstring path) {
+    DWORD len = GetFullPathNameW(path.c_str(), 0, nullptr, nullptr);
+    std::wstring buffer(len-1, L'\0'); // subtract null-termination
+    len = GetFullPathNameW(path.c_str(), len, const_cast<wchar_t*>(buffer.data()), nullptr);
+    return buffer;
+}
+
+/** Case-insensitive check of file extension (including leading dot). */
+static bool HasFileExtension (const std::wstring& path, const wchar_t* ext) {
+    size_t len = wcslen(ext);
+    return (path.size() > len) && (_wcsicmp(path.c_str() + path.size() - len, ext) == 0);
+}
+
+/** Check if a path has ".msi" extension. */
+static bool HasMsiExtension (const std::wstring& path) {
+    return HasFileExtension(path, L".msi");
+}
+
+/** Check if a path is a MSIX/AppX package or bundle. */
+static bool HasMsixExtension (const std::wstring& path) {
+    return HasFileExtension(path, L".msix") || HasFileExtension(path, L".appx") || HasFileExtension(path, L".msixbundle") || HasFileExtension(path, L".appxbundle");
+}
+
+/** Recursively find all *.msi files in a folder. Non-folder arguments are returned as-is. */
+static std::vector<std::wstring> FindMsiFiles (std::wstring path) {
+    path = ToAbsolutePath(path);
+
+    DWORD attribs = GetFileAttributesW(path.c_str());
+    if ((attribs == INVALID_FILE_ATTRIBUTES) || !(attribs & FILE_ATTRIBUTE_DIRECTORY))
+        return {path}; // assume MSI file
+
+    std::vector<std::wstring> result;
+    WIN32_FIND_DATAW data = {};
+    HANDLE find = FindFirstFileW((path + L"\\*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE)
+        return result;
+
+    do {
+        std::wstring name = data.cFileName;
+        if ((name == L".") || (name == L".."))
+            continue;
+
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            std::vector<std::wstring> sub = FindMsiFiles(path + L'\\' + name);
+            result.insert(result.end(), sub.begin(), sub.end());
+        } else if (HasMsiExtension(name)) {
+            result.push_back(path + L'\\' + name);
+        }
+    } while (FindNextFileW(find, &data));
+    FindClose(find);
+
+    return result;
 }
 
 /** Get info about a MSI product that is not neccesarily installed. */
@@ -44,11 +88,12 @@ static std::wstring GetProductProperty (MSIHANDLE msi, const wchar_t* property,
 }
 
 /** Get info for published & installed products. */
-static std::wstring GetProductInfo (const std::wstring& product_code, const wchar_t* attribute) {
+static std::wstring GetProductInfo (const Guid& product_code, const wchar_t* attribute) {
     wchar_t EMPTY_STRING[] = L""; // cannot const_cast(L"") since MsiGetProductInfo will write to empty string
+    const std::wstring product_str = product_code.ToString();
 
     DWORD buf_len = 0;
-    UINT ret = MsiGetProductInfoW(product_code.c_str(), attribute, EMPTY_STRING, &buf_len);
+    UINT ret = MsiGetProductInfoW(product_str.c_str(), attribute, EMPTY_STRING, &buf_len);
     if (ret == ERROR_SUCCESS)
         return EMPTY_STRING;
     else if (ret == ERROR_UNKNOWN_PRODUCT)
@@ -60,14 +105,17 @@ static std::wstring GetProductInfo (const std::wstring& product_code, const wcha
         buf_len = 38; // increase buffer to fit a GUID string (prevents additional ERROR_MORE_DATA)
 
     std::wstring buffer(buf_len++, L'\0');
-    ret = MsiGetProductInfoW(product_code.c_str(), attribute, const_cast<wchar_t*>(buffer.data()), &buf_len);
+    ret = MsiGetProductInfoW(product_str.c_str(), attribute, const_cast<wchar_t*>(buffer.data()), &buf_len);
     if (ret != ERROR_SUCCESS)
         throw std::runtime_error("MsiGetProductInfo failed");
     return buffer;
 }
 
 
-static std::wstring GetComponentPath (const std::wstring& product, const std::wstring& component) {
+static std::wstring GetComponentPath (const Guid& product_code, const Guid& component_id) {
+    const std::wstring product = product_code.ToString();
+    const std::wstring component = component_id.ToString();
+
     DWORD buf_len = 0;
     INSTALLSTATE ret = MsiGetComponentPathW(product.c_str(), component.c_str(), nullptr, &buf_len);
     if (ret == INSTALLSTATE_ABSENT)
@@ -82,13 +130,13 @@ static std::wstring GetComponentPath (const std::wstring& product, const std::ws
     return buffer;
 }
 
-/** Returns the first ProductCode associated with a given UpgradeCode, or "" if unknown. */
-static std::wstring GetFirstProductCode (const std::wstring& upgrade_code) {
-    std::wstring buffer(38, L'\0'); // fixed length
+/** Returns the first ProductCode associated with a given UpgradeCode, or a null GUID if unknown. */
+static Guid GetFirstProductCode (const Guid& upgrade_code) {
+    wchar_t buffer[39] = {}; // fixed length incl. null-termination
     DWORD idx = 0;
-    UINT ret = MsiEnumRelatedProductsW(upgrade_code.c_str(), NULL, idx, const_cast<wchar_t*>(buffer.data()));
+    UINT ret = MsiEnumRelatedProductsW(upgrade_code.ToString().c_str(), NULL, idx, buffer);
     if (ret != ERROR_SUCCESS)
-        return L""; // none found
+        return Guid(); // none found
 
-    return buffer;
+    return Guid::Parse(buffer);
 }
@@ -0,0 +1,459 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cwchar>
+#include <cwctype>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "MsiTables.hpp"
+
+
+/** Referential integrity or column validation failure. */
+struct ValidationIssue {
+    std::wstring Table;
+    std::wstring Column;
+    std::wstring Key;     ///< primary key of offending row (empty for table-level issues)
+    std::wstring Message;
+
+    bool operator < (const ValidationIssue& other) const {
+        if (Table != other.Table)
+            return Table < other.Table;
+        if (Column != other.Column)
+            return Column < other.Column;
+        return Key < other.Key;
+    }
+};
+
+
+/** Validation of foreign keys, Directory tree structure and column values against the _Validation table.
+    Similar to a subset of the ICE checks performed by msival2, but foreign keys are checked as hash semi-joins
+    and all checks run in parallel.
+    REF: https://learn.microsoft.com/en-us/windows/win32/msi/-validation-table */
+class MsiValidator {
+public:
+    MsiValidator(std::vector<GenericTable> tables) {
+        for (GenericTable& table : tables) {
+            std::wstring name = table.Name;
+            m_tables[name] = std::move(table);
+        }
+    }
+
+    /** Run all checks. Returns violations sorted by table, column and row. */
+    std::vector<ValidationIssue> Run() const {
+        std::vector<ForeignKey> foreign_keys = ForeignKeys();
+
+        // build key sets of all referenced columns
+        std::map<std::pair<std::wstring, size_t>, std::unordered_set<std::wstring>> key_sets;
+        for (const ForeignKey& fk : foreign_keys) {
+            for (const std::wstring& key_table : fk.KeyTables)
+                key_sets[{key_table, fk.KeyColumn}];
+        }
+        key_sets[{L"Binary", 0}];
+        key_sets[{L"File", 0}];
+        key_sets[{L"Directory", 0}];
+
+        std::vector<std::function<void()>> build_tasks;
+        for (auto& key_set : key_sets) {
+            build_tasks.push_back([this, &key_set]() {
+                const GenericTable* table = Find(key_set.first.first);
+                if (!table || (key_set.first.second >= table->Columns.size()))
+                    return;
+                key_set.second.reserve(table->Rows());
+                for (size_t row = 0; row < table->Rows(); ++row)
+                    key_set.second.insert(table->Get(row, key_set.first.second));
+            });
+        }
+        RunParallel(build_tasks);
+
+        // checks are independent, and only read the tables and key sets
+        std::vector<std::vector<ValidationIssue>> results;
+        std::vector<std::function<void()>> check_tasks;
+        results.resize(foreign_keys.size() + m_tables.size() + 2);
+        size_t idx = 0;
+        for (const ForeignKey& fk : foreign_keys) {
+            std::vector<ValidationIssue>* out = &results[idx++];
+            check_tasks.push_back([this, &fk, &key_sets, out]() {
+                CheckForeignKey(fk, key_sets, *out);
+            });
+        }
+        for (auto& table : m_tables) {
+            std::vector<ValidationIssue>* out = &results[idx++];
+            const GenericTable* ptr = &table.second;
+            check_tasks.push_back([this, ptr, out]() {
+                CheckColumns(*ptr, *out);
+            });
+        }
+        {
+            std::vector<ValidationIssue>* out = &results[idx++];
+            check_tasks.push_back([this, &key_sets, out]() {
+                CheckCustomActionSources(key_sets, *out);
+            });
+        }
+        {
+            std::vector<ValidationIssue>* out = &results[idx++];
+            check_tasks.push_back([this, out]() {
+                CheckDirectoryTree(*out);
+            });
+        }
+        RunParallel(check_tasks);
+
+        std::vector<ValidationIssue> issues;
+        for (auto& result : results)
+            issues.insert(issues.end(), result.begin(), result.end());
+        std::stable_sort(issues.begin(), issues.end());
+        return issues;
+    }
+
+private:
+    struct ForeignKey {
+        std::wstring              Table;
+        std::wstring              Column;
+        std::vector<std::wstring> KeyTables; ///< referenced tables (value must be present in one of them)
+        size_t                    KeyColumn = 0; ///< referenced column index
+        std::wstring              Category;      ///< _Validation category
+    };
+
+    const GenericTable* Find(const std::wstring& name) const {
+        auto it = m_tables.find(name);
+        if (it == m_tables.end())
+            return nullptr;
+        return &it->second;
+    }
+
+    /** Foreign keys from the _Validation table, together with the most important ones in case _Validation is incomplete. */
+    std::vector<ForeignKey> ForeignKeys() const {
+        std::map<std::pair<std::wstring, std::wstring>, ForeignKey> result;
+
+        static const wchar_t* BUILTIN[][3] = {
+            {L"File", L"Component_", L"Component"},
+            {L"Component", L"Directory_", L"Directory"},
+            {L"Registry", L"Component_", L"Component"},
+            {L"FeatureComponents", L"Feature_", L"Feature"},
+            {L"FeatureComponents", L"Component_", L"Component"},
+            {L"Directory", L"Directory_Parent", L"Directory"},
+        };
+        for (auto& fk : BUILTIN) {
+            if (Find(fk[0]))
+                result[{fk[0], fk[1]}] = {fk[0], fk[1], {fk[2]}, 0, L""};
+        }
+
+        if (const GenericTable* validation = Find(L"_Validation")) {
+            int table_col = validation->ColumnIndex(L"Table");
+            int column_col = validation->ColumnIndex(L"Column");
+            int key_table_col = validation->ColumnIndex(L"KeyTable");
+            int key_column_col = validation->ColumnIndex(L"KeyColumn");
+            if ((table_col < 0) || (column_col < 0) || (key_table_col < 0) || (key_column_col < 0))
+                return Values(result);
+
+            for (size_t row = 0; row < validation->Rows(); ++row) {
+                const std::wstring& key_tables = validation->Get(row, key_table_col);
+                const std::wstring& key_column = validation->Get(row, key_column_col);
+                if (key_tables.empty() || key_column.empty())
+                    continue;
+
+                ForeignKey fk;
+                fk.Table = validation->Get(row, table_col);
+                fk.Column = validation->Get(row, column_col);
+                fk.KeyTables = Split(key_tables, L';');
+                fk.KeyColumn = static_cast<size_t>((std::max)(1l, wcstol(key_column.c_str(), nullptr, 10)) - 1); // 1-based
+                int category_col = validation->ColumnIndex(L"Category");
+                if (category_col >= 0)
+                    fk.Category = validation->Get(row, category_col);
+                if (!Find(fk.Table))
+                    continue;
+                if ((fk.Table == L"CustomAction") && (fk.Column == L"Source"))
+                    continue; // depends on action type, checked separately
+                result[{fk.Table, fk.Column}] = fk;
+            }
+        }
+
+        return Values(result);
+    }
+
+    /** Semi-join of a foreign key column against the referenced key sets. */
+    void CheckForeignKey(const ForeignKey& fk, const std::map<std::pair<std::wstring, size_t>, std::unordered_set<std::wstring>>& key_sets, std::vector<ValidationIssue>& out) const {
+        const GenericTable& table = *Find(fk.Table);
+        int col = table.ColumnIndex(fk.Column);
+        if (col < 0)
+            return;
+
+        std::vector<const std::unordered_set<std::wstring>*> keys;
+        for (const std::wstring& key_table : fk.KeyTables) {
+            if (Find(key_table))
+                keys.push_back(&key_sets.at({key_table, fk.KeyColumn}));
+        }
+
+        for (size_t row = 0; row < table.Rows(); ++row) {
+            const std::wstring& value = table.Get(row, col);
+            if (value.empty())
+                continue; // NULL values are checked against nullability instead
+
+            bool found = std::any_of(keys.begin(), keys.end(), [&value](const std::unordered_set<std::wstring>* set) {
+                return set->count(value) > 0;
+            });
+            if (!found && (fk.Category == L"Version") && IsVersion(value))
+                found = true; // File.Version can either be a version or refer to a companion file
+            if (!found)
+                out.push_back({fk.Table, fk.Column, table.RowKey(row), L"'" + value + L"' not found in " + Join(fk.KeyTables, L"/") + L" table"});
+        }
+    }
+
+    /** Check column values against the column definitions and the _Validation table. */
+    void CheckColumns(const GenericTable& table, std::vector<ValidationIssue>& out) const {
+        const GenericTable* validation = Find(L"_Validation");
+        std::map<std::wstring, size_t> rules; // column -> _Validation row
+        if (validation) {
+            int table_col = validation->ColumnIndex(L"Table");
+            int column_col = validation->ColumnIndex(L"Column");
+            if ((table_col >= 0) && (column_col >= 0)) {
+                for (size_t row = 0; row < validation->Rows(); ++row) {
+                    if (validation->Get(row, table_col) == table.Name)
+                        rules[validation->Get(row, column_col)] = row;
+                }
+            }
+        }
+
+        for (size_t col = 0; col < table.Columns.size(); ++col) {
+            const std::wstring& type = table.ColumnTypes[col];
+            bool nullable = !type.empty() && iswupper(type[0]);
+            bool integer = !type.empty() && ((towlower(type[0]) == L'i') || (towlower(type[0]) == L'j'));
+
+            Rule rule;
+            auto it = rules.find(table.Columns[col]);
+            if (it != rules.end()) {
+                rule = ParseRule(*validation, it->second);
+                if (!rule.Nullable && nullable)
+                    out.push_back({table.Name, table.Columns[col], L"", L"Nullable column is declared as non-nullable in _Validation"});
+            } else if (validation && (table.Name[0] != L'_')) {
+                out.push_back({table.Name, table.Columns[col], L"", L"Column not listed in _Validation"});
+            }
+
+            for (size_t row = 0; row < table.Rows(); ++row) {
+                const std::wstring& value = table.Get(row, col);
+                std::wstring error = CheckValue(value, nullable && rule.Nullable, integer, rule);
+                if (!error.empty())
+                    out.push_back({table.Name, table.Columns[col], table.RowKey(row), error});
+            }
+        }
+    }
+
+    /** CustomAction.Source refers to the Binary, File or Directory table depending on the action type.
+        REF: https://learn.microsoft.com/en-us/windows/win32/msi/summary-list-of-all-custom-action-types */
+    void CheckCustomActionSources(const std::map<std::pair<std::wstring, size_t>, std::unordered_set<std::wstring>>& key_sets, std::vector<ValidationIssue>& out) const {
+        const GenericTable* table = Find(L"CustomAction");
+        if (!table)
+            return;
+        int type_col = table->ColumnIndex(L"Type");
+        int source_col = table->ColumnIndex(L"Source");
+        if ((type_col < 0) || (source_col < 0))
+            return;
+
+        for (size_t row = 0; row < table->Rows(); ++row) {
+            int type = static_cast<int>(wcstol(table->Get(row, type_col).c_str(), nullptr, 10));
+            int base = type & 0x07;   // DLL, EXE, text, JScript, VBScript or nested install
+            int source = type & 0x30; // Binary, File, Directory or Property
+
+            const wchar_t* key_table = nullptr;
+            if ((source == 0x00) && ((base == 1) || (base == 2) || (base == 5) || (base == 6)))
+                key_table = L"Binary";
+            else if ((source == 0x10) && ((base == 1) || (base == 2) || (base == 5) || (base == 6)))
+                key_table = L"File";
+            else if ((source == 0x20) && ((base == 2) || (base == 3)))
+                key_table = L"Directory"; // EXE working directory or directory assignment
+            if (!key_table)
+                continue;
+
+            const std::wstring& value = table->Get(row, source_col);
+            if (value.empty())
+                out.push_back({table->Name, L"Source", table->RowKey(row), L"Missing source for custom action type " + std::to_wstring(type)});
+            else if (!key_sets.at({key_table, 0}).count(value))
+                out.push_back({table->Name, L"Source", table->RowKey(row), L"'" + value + L"' not found in " + key_table + L" table"});
+        }
+    }
+
+    /** Detect cycles in the Directory_Parent hierarchy. Root directories have a NULL parent or refer to themselves. */
+    void CheckDirectoryTree(std::vector<ValidationIssue>& out) const {
+        const GenericTable* table = Find(L"Directory");
+        if (!table)
+            return;
+        int dir_col = table->ColumnIndex(L"Directory");
+        int parent_col = table->ColumnIndex(L"Directory_Parent");
+        if ((dir_col < 0) || (parent_col < 0))
+            return;
+
+        const size_t NONE = static_cast<size_t>(-1);
+        std::unordered_map<std::wstring, size_t> rows;
+        for (size_t row = 0; row < table->Rows(); ++row)
+            rows[table->Get(row, dir_col)] = row;
+
+        std::vector<size_t> parents(table->Rows(), NONE);
+        for (size_t row = 0; row < table->Rows(); ++row) {
+            auto it = rows.find(table->Get(row, parent_col));
+            if ((it != rows.end()) && (it->second != row))
+                parents[row] = it->second;
+        }
+
+        enum State : uint8_t { UNVISITED, IN_PROGRESS, DONE };
+        std::vector<State> state(table->Rows(), UNVISITED);
+        std::vector<size_t> path;
+        for (size_t start = 0; start < table->Rows(); ++start) {
+            path.clear();
+            size_t row = start;
+            while ((row != NONE) && (state[row] == UNVISITED)) {
+                state[row] = IN_PROGRESS;
+                path.push_back(row);
+                row = parents[row];
+            }
+
+            if ((row != NONE) && (state[row] == IN_PROGRESS)) {
+                // walked back into the current path
+                std::wstring cycle = table->Get(row, dir_col);
+                for (size_t i = std::find(path.begin(), path.end(), row) - path.begin() + 1; i < path.size(); ++i)
+                    cycle += L" -> " + table->Get(path[i], dir_col);
+                cycle += L" -> " + table->Get(row, dir_col);
+                out.push_back({table->Name, L"Directory_Parent", table->Get(row, dir_col), L"Cycle in directory hierarchy: " + cycle});
+            }
+
+            for (size_t visited : path)
+                state[visited] = DONE;
+        }
+    }
+
+    /** Column rule from the _Validation table. */
+    struct Rule {
+        bool                      Nullable = true;
+        bool                      HasKeyTable = false; ///< value is checked as foreign key instead
+        bool                      HasMin = false, HasMax = false;
+        long                      MinValue = 0, MaxValue = 0;
+        std::wstring              Category;
+        std::vector<std::wstring> Set;
+    };
+
+    static Rule ParseRule(const GenericTable& validation, size_t row) {
+        Rule rule;
+        auto get = [&](const wchar_t* column) -> std::wstring {
+            int col = validation.ColumnIndex(column);
+            return (col >= 0) ? validation.Get(row, col) : L"";
+        };
+
+        rule.Nullable = (get(L"Nullable") != L"N");
+        std::wstring min_value = get(L"MinValue"), max_value = get(L"MaxValue");
+        if (!min_value.empty()) {
+            rule.HasMin = true;
+            rule.MinValue = wcstol(min_value.c_str(), nullptr, 10);
+        }
+        if (!max_value.empty()) {
+            rule.HasMax = true;
+            rule.MaxValue = wcstol(max_value.c_str(), nullptr, 10);
+        }
+        rule.HasKeyTable = !get(L"KeyTable").empty();
+        rule.Category = get(L"Category");
+        std::wstring set = get(L"Set");
+        if (!set.empty())
+            rule.Set = Split(set, L';');
+        return rule;
+    }
+
+    /** Returns error message, or empty string if the value is valid. */
+    static std::wstring CheckValue(const std::wstring& value, bool nullable, bool integer, const Rule& rule) {
+        if (value.empty())
+            return nullable ? L"" : L"NULL value in non-nullable column";
+
+        if (integer) {
+            wchar_t* end = nullptr;
+            long number = wcstol(value.c_str(), &end, 10);
+            if (*end != L'\0')
+                return L"'" + value + L"' is not an integer";
+            if ((rule.HasMin && (number < rule.MinValue)) || (rule.HasMax && (number > rule.MaxValue)))
+                return L"Value " + value + L" outside the range [" + std::to_wstring(rule.MinValue) + L", " + std::to_wstring(rule.MaxValue) + L"]";
+        }
+
+        if (!rule.Set.empty() && (std::find(rule.Set.begin(), rule.Set.end(), value) == rule.Set.end()))
+            return L"'" + value + L"' is not in the allowed set " + Join(rule.Set, L";");
+
+        // REF: https://learn.microsoft.com/en-us/windows/win32/msi/column-data-types
+        if (rule.Category == L"Identifier") {
+            bool valid = (iswalpha(value[0]) || (value[0] == L'_')) && std::all_of(value.begin(), value.end(), [](wchar_t c) {
+                return iswalnum(c) || (c == L'_') || (c == L'.');
+            });
+            if (!valid)
+                return L"'" + value + L"' is not a valid Identifier";
+        } else if (rule.Category == L"Guid") {
+            Guid guid;
+            if (!Guid::TryParse(value, guid) || std::any_of(value.begin(), value.end(), [](wchar_t c) { return iswlower(c) != 0; }))
+                return L"'" + value + L"' is not an uppercase GUID";
+        } else if (rule.Category == L"UpperCase") {
+            if (std::any_of(value.begin(), value.end(), [](wchar_t c) { return iswlower(c) != 0; }))
+                return L"'" + value + L"' is not UpperCase";
+        } else if (rule.Category == L"LowerCase") {
+            if (std::any_of(value.begin(), value.end(), [](wchar_t c) { return iswupper(c) != 0; }))
+                return L"'" + value + L"' is not LowerCase";
+        } else if ((rule.Category == L"Version") && !rule.HasKeyTable) {
+            if (!IsVersion(value))
+                return L"'" + value + L"' is not a valid Version";
+        }
+
+        return L"";
+    }
+
+    /** Check for "major.minor.build.revision" version with up to four 16bit parts. */
+    static bool IsVersion(const std::wstring& value) {
+        std::vector<std::wstring> parts = Split(value, L'.');
+        return (parts.size() <= 4) && std::all_of(parts.begin(), parts.end(), [](const std::wstring& part) {
+            return !part.empty() && (part.size() <= 5) && std::all_of(part.begin(), part.end(), [](wchar_t c) { return (c >= L'0') && (c <= L'9'); }) && (wcstol(part.c_str(), nullptr, 10) <= 65535);
+        });
+    }
+
+    /** Run tasks on all CPU cores. */
+    static void RunParallel(const std::vector<std::function<void()>>& tasks) {
+        std::atomic<size_t> next(0);
+        auto worker = [&]() {
+            for (size_t idx = next++; idx < tasks.size(); idx = next++)
+                tasks[idx]();
+        };
+
+        std::vector<std::thread> threads;
+        unsigned int thread_count = (std::min)(static_cast<unsigned int>(tasks.size()), (std::max)(1u, std::thread::hardware_concurrency()));
+        for (unsigned int i = 0; i < thread_count; ++i)
+            threads.emplace_back(worker);
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    static std::vector<std::wstring> Split(const std::wstring& str, wchar_t separator) {
+        std::vector<std::wstring> result;
+        size_t start = 0;
+        while (true) {
+            size_t end = str.find(separator, start);
+            result.push_back(str.substr(start, end - start));
+            if (end == std::wstring::npos)
+                break;
+            start = end + 1;
+        }
+        return result;
+    }
+
+    static std::wstring Join(const std::vector<std::wstring>& parts, const wchar_t* separator) {
+        std::wstring result;
+        for (size_t i = 0; i < parts.size(); ++i) {
+            if (i > 0)
+                result += separator;
+            result += parts[i];
+        }
+        return result;
+    }
+
+    static std::vector<ForeignKey> Values(const std::map<std::pair<std::wstring, std::wstring>, ForeignKey>& map) {
+        std::vector<ForeignKey> result;
+        for (auto& elm : map)
+            result.push_back(elm.second);
+        return result;
+    }
+
+    std::map<std::wstring, GenericTable> m_tables;
+};
@@ -0,0 +1,303 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "TextConv.hpp"
+#include "ZipReader.hpp"
+
+
+/** Minimal forward-only XML scanner for UTF-8 documents.
+    Reports start tags with attributes, end tags and character data through a handler without building a DOM.
+    DTDs, comments, processing instructions and CDATA sections are skipped. Namespace prefixes are stripped from element names. */
+class XmlScanner {
+public:
+    typedef std::vector<std::pair<std::string, std::string>> Attributes;
+
+    /** Handler must provide StartElement(name, attributes), EndElement(name) and Text(text). */
+    template <class Handler>
+    static void Scan(const uint8_t* data, size_t size, Handler& handler) {
+        const char* pos = reinterpret_cast<const char*>(data);
+        const char* end = pos + size;
+        if ((size >= 3) && (data[0] == 0xEF) && (data[1] == 0xBB) && (data[2] == 0xBF))
+            pos += 3; // skip UTF-8 BOM
+
+        Attributes attributes;
+        while (pos < end) {
+            if (*pos != '<') {
+                const char* text_end = Find(pos, end, "<");
+                handler.Text(Decode(pos, text_end));
+                pos = text_end;
+                continue;
+            }
+
+            if (StartsWith(pos, end, "<!--")) {
+                pos = Skip(pos, end, "-->");
+            } else if (StartsWith(pos, end, "<![CDATA[")) {
+                const char* cdata_end = Find(pos + 9, end, "]]>");
+                handler.Text(std::string(pos + 9, cdata_end));
+                pos = Skip(pos, end, "]]>");
+            } else if (StartsWith(pos, end, "<?")) {
+                pos = Skip(pos, end, "?>");
+            } else if (StartsWith(pos, end, "<!")) {
+                pos = Skip(pos, end, ">"); // DOCTYPE (internal subsets not supported)
+            } else if (StartsWith(pos, end, "</")) {
+                pos += 2;
+                std::string name = ReadName(pos, end);
+                pos = Skip(pos, end, ">");
+                handler.EndElement(LocalName(name));
+            } else {
+                ++pos;
+                std::string name = ReadName(pos, end);
+                attributes.clear();
+                bool empty_element = false;
+                while (true) {
+                    SkipSpace(pos, end);
+                    if (pos >= end)
+                        throw std::runtime_error("Unterminated XML tag");
+                    if (*pos == '>') {
+                        ++pos;
+                        break;
+                    }
+                    if (StartsWith(pos, end, "/>")) {
+                        pos += 2;
+                        empty_element = true;
+                        break;
+                    }
+
+                    std::string attr_name = ReadName(pos, end);
+                    SkipSpace(pos, end);
+                    if ((pos >= end) || (*pos != '='))
+                        throw std::runtime_error("Malformed XML attribute");
+                    ++pos;
+                    SkipSpace(pos, end);
+                    if ((pos >= end) || ((*pos != '"') && (*pos != '\'')))
+                        throw std::runtime_error("Malformed XML attribute");
+                    char quote = *pos++;
+                    const char* value_end = Find(pos, end, quote == '"' ? "\"" : "'");
+                    if (value_end == end)
+                        throw std::runtime_error("Unterminated XML attribute");
+                    attributes.emplace_back(attr_name, Decode(pos, value_end));
+                    pos = value_end + 1;
+                }
+
+                std::string local_name = LocalName(name);
+                handler.StartElement(local_name, attributes);
+                if (empty_element)
+                    handler.EndElement(local_name);
+            }
+        }
+    }
+
+    /** Get attribute value. Returns empty string if not present. Namespace prefixes are ignored. */
+    static std::string Attribute(const Attributes& attributes, const char* name) {
+        for (const auto& attr : attributes) {
+            if (LocalName(attr.first) == name)
+                return attr.second;
+        }
+        return "";
+    }
+
+private:
+    static bool StartsWith(const char* pos, const char* end, const char* prefix) {
+        for (; *prefix; ++pos, ++prefix) {
+            if ((pos >= end) || (*pos != *prefix))
+                return false;
+        }
+        return true;
+    }
+
+    /** Returns position of "token", or "end" if not found. */
+    static const char* Find(const char* pos, const char* end, const char* token) {
+        for (; pos < end; ++pos) {
+            if (StartsWith(pos, end, token))
+                return pos;
+        }
+        return end;
+    }
+
+    /** Returns position after "token". */
+    static const char* Skip(const char* pos, const char* end, const char* token) {
+        const char* found = Find(pos, end, token);
+        if (found == end)
+            throw std::runtime_error("Unterminated XML construct");
+        return found + strlen(token);
+    }
+
+    static void SkipSpace(const char*& pos, const char* end) {
+        while ((pos < end) && ((*pos == ' ') || (*pos == '\t') || (*pos == '\r') || (*pos == '\n')))
+            ++pos;
+    }
+
+    static std::string ReadName(const char*& pos, const char* end) {
+        const char* begin = pos;
+        while ((pos < end) && (*pos != '>') && (*pos != '/') && (*pos != '=') && (*pos != ' ') && (*pos != '\t') && (*pos != '\r') && (*pos != '\n'))
+            ++pos;
+        if (pos == begin)
+            throw std::runtime_error("Malformed XML name");
+        return std::string(begin, pos);
+    }
+
+    static std::string LocalName(const std::string& name) {
+        size_t idx = name.find(':');
+        if (idx == std::string::npos)
+            return name;
+        return name.substr(idx + 1);
+    }
+
+    /** Resolve predefined and numeric character references. */
+    static std::string Decode(const char* begin, const char* end) {
+        std::string result;
+        result.reserve(end - begin);
+        for (const char* pos = begin; pos < end; ++pos) {
+            if (*pos != '&') {
+                result += *pos;
+                continue;
+            }
+
+            const char* semicolon = Find(pos, end, ";");
+            std::string entity(pos + 1, semicolon);
+            if (entity == "amp")
+                result += '&';
+            else if (entity == "lt")
+                result += '<';
+            else if (entity == "gt")
+                result += '>';
+            else if (entity == "quot")
+                result += '"';
+            else if (entity == "apos")
+                result += '\'';
+            else if ((entity.size() > 1) && (entity[0] == '#'))
+                AppendUtf8(result, CharRef(entity));
+            else
+                result.append(pos, semicolon < end ? semicolon + 1 : end); // unknown entity, keep as-is
+
+            pos = (semicolon < end) ? semicolon : end - 1;
+        }
+        return result;
+    }
+
+    /** Code point of a "#NNN" or "#xHHH" character reference. Out-of-range values are clamped so that they are replaced when encoded. */
+    static uint32_t CharRef(const std::string& entity) {
+        unsigned long cp = (entity[1] == 'x') ? strtoul(entity.c_str() + 2, nullptr, 16) : strtoul(entity.c_str() + 1, nullptr, 10);
+        return (cp > 0x10FFFF) ? 0x110000 : static_cast<uint32_t>(cp);
+    }
+};
+
+
+/** Package identity and declarations from an AppxManifest.xml or AppxBundleManifest.xml file. Strings are UTF-8 encoded.
+    REF: https://learn.microsoft.com/en-us/uwp/schemas/appxpackage/appx-package-manifest
+    REF: https://learn.microsoft.com/en-us/uwp/schemas/bundlemanifestschema/bundle-manifest */
+struct MsixManifest {
+    struct Application {
+        std::string Id;
+        std::string Executable;
+        std::string EntryPoint;
+    };
+    struct Extension {
+        std::string Category;
+        std::string Executable; ///< optional
+    };
+    /** Package listed in a bundle manifest. */
+    struct BundlePackage {
+        std::string Type;         ///< "application" or "resource"
+        std::string Version;
+        std::string Architecture;
+        std::string FileName;
+    };
+
+    bool IsBundle = false;
+    // Identity element
+    std::string Name;
+    std::string Version;
+    std::string Publisher;
+    std::string ProcessorArchitecture;
+    // Properties element
+    std::string DisplayName;
+    std::string PublisherDisplayName;
+
+    std::vector<std::string>   Capabilities;
+    std::vector<Application>   Applications;
+    std::vector<Extension>     Extensions;
+    std::vector<BundlePackage> Packages;
+
+    /** Parse manifest XML. Bundle manifests are detected from the "Bundle" root element. */
+    static MsixManifest Parse(const uint8_t* xml, size_t size);
+
+    /** Locate and parse the manifest of a .msix/.appx package or .msixbundle/.appxbundle bundle. */
+    static MsixManifest Read(const ZipArchive& archive);
+};
+
+
+/** XmlScanner handler that populates a MsixManifest. */
+class MsixManifestHandler {
+public:
+    void StartElement(const std::string& name, const XmlScanner::Attributes& attributes) {
+        const std::string parent = stack.empty() ? "" : stack.back();
+        stack.push_back(name);
+        text_target = nullptr;
+
+        if (stack.size() == 1) {
+            manifest.IsBundle = (name == "Bundle");
+        } else if ((name == "Identity") && (stack.size() == 2)) {
+            manifest.Name = XmlScanner::Attribute(attributes, "Name");
+            manifest.Version = XmlScanner::Attribute(attributes, "Version");
+            manifest.Publisher = XmlScanner::Attribute(attributes, "Publisher");
+            manifest.ProcessorArchitecture = XmlScanner::Attribute(attributes, "ProcessorArchitecture");
+        } else if (parent == "Properties") {
+            if (name == "DisplayName")
+                text_target = &manifest.DisplayName;
+            else if (name == "PublisherDisplayName")
+                text_target = &manifest.PublisherDisplayName;
+        } else if ((parent == "Capabilities") && ((name == "Capability") || (name == "DeviceCapability") || (name == "CustomCapability"))) {
+            manifest.Capabilities.push_back(XmlScanner::Attribute(attributes, "Name"));
+        } else if ((parent == "Applications") && (name == "Application")) {
+            manifest.Applications.push_back({XmlScanner::Attribute(attributes, "Id"), XmlScanner::Attribute(attributes, "Executable"), XmlScanner::Attribute(attributes, "EntryPoint")});
+        } else if ((parent == "Extensions") && (name == "Extension")) {
+            manifest.Extensions.push_back({XmlScanner::Attribute(attributes, "Category"), XmlScanner::Attribute(attributes, "Executable")});
+        } else if ((parent == "Packages") && (name == "Package")) {
+            std::string type = XmlScanner::Attribute(attributes, "Type");
+            if (type.empty())
+                type = "application"; // schema default
+            manifest.Packages.push_back({type, XmlScanner::Attribute(attributes, "Version"), XmlScanner::Attribute(attributes, "Architecture"), XmlScanner::Attribute(attributes, "FileName")});
+        }
+    }
+
+    void EndElement(const std::string& /*name*/) {
+        if (!stack.empty())
+            stack.pop_back();
+        text_target = nullptr;
+    }
+
+    void Text(const std::string& text) {
+        if (text_target)
+            *text_target += text;
+    }
+
+    MsixManifest             manifest;
+
+private:
+    std::vector<std::string> stack;                 ///< open element names
+    std::string*             text_target = nullptr; ///< field receiving character data
+};
+
+
+inline MsixManifest MsixManifest::Parse(const uint8_t* xml, size_t size) {
+    MsixManifestHandler handler;
+    XmlScanner::Scan(xml, size, handler);
+    return std::move(handler.manifest);
+}
+
+inline MsixManifest MsixManifest::Read(const ZipArchive& archive) {
+    const ZipArchive::Entry* entry = archive.Find("AppxManifest.xml");
+    if (!entry)
+        entry = archive.Find("AppxMetadata/AppxBundleManifest.xml");
+    if (!entry)
+        throw std::runtime_error("Package manifest not found");
+
+    std::vector<uint8_t> xml = archive.Extract(*entry);
+    return Parse(xml.data(), xml.size());
+}
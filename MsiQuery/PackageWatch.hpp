@@ -0,0 +1,341 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MappedFile.hpp"
+#include "MsiQuery.hpp"
+#include "MsiUtil.hpp"
+
+
+/** Summary of a single analyzed package. */
+struct PackageSummary {
+    uint64_t     LastWrite = 0; ///< FILETIME of the analyzed file
+    uint64_t     Size = 0;      ///< file size of the analyzed file
+    Guid         ProductCode;
+    std::wstring ProductName;
+    std::wstring ProductVersion;
+    std::wstring Manufacturer;
+    size_t       Features = 0;
+    size_t       Files = 0;
+    size_t       Components = 0;
+    size_t       RegistryEntries = 0;
+    size_t       CustomActions = 0;
+    std::wstring Error;         ///< non-empty if the analysis failed
+};
+
+
+/** Analyze a MSI file into a PackageSummary. Failures are reported through the Error field. */
+static PackageSummary SummarizeMsiFile (const std::wstring& msi_file) {
+    PackageSummary summary;
+    try {
+        MsiQuery query(msi_file);
+
+        PropertyTable properties = query.QueryProperty();
+        auto property = [&properties](const wchar_t* name) {
+            const std::wstring* value = properties.Find(name);
+            return value ? *value : std::wstring();
+        };
+        summary.ProductCode = Guid::Parse(property(L"ProductCode")); // REQUIRED
+        summary.ProductName = property(L"ProductName");
+        summary.ProductVersion = property(L"ProductVersion");
+        summary.Manufacturer = property(L"Manufacturer");
+
+        summary.Features = query.QueryFeature().size();
+        summary.Files = query.QueryFile().Entries().size();
+        summary.Components = query.QueryComponent().Entries().size();
+        summary.RegistryEntries = query.QueryRegistry().size();
+        summary.CustomActions = query.QueryCustomAction().size();
+    } catch (const std::exception& err) {
+        summary.Error = ToUnicode(err.what());
+    }
+    return summary;
+}
+
+
+/** Long-running watch of a folder tree that re-analyzes new or modified MSI files.
+    Change notifications come from ReadDirectoryChangesW. Writes are debounced until a file has been idle for SETTLE_TIME_MS and is no longer opened for writing.
+    The result set is kept in memory and persisted as a tab-separated summary file, so that a restart only re-analyzes packages that changed in the meantime. */
+class PackageWatcher {
+public:
+    static const DWORD SETTLE_TIME_MS = 2000;
+    static const DWORD POLL_INTERVAL_MS = 500;
+
+    PackageWatcher(const std::wstring& folder, const std::wstring& summary_file) : m_folder(ToAbsolutePath(folder)), m_summary_file(ToAbsolutePath(summary_file)) {
+    }
+
+    /** Watch folder until an error occurs. */
+    void Run() {
+        std::unique_ptr<void, decltype(&CloseHandle)> dir(CreateFileW(m_folder.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr), CloseHandle);
+        if (dir.get() == INVALID_HANDLE_VALUE) {
+            dir.release();
+            throw std::runtime_error("Unable to open watch folder");
+        }
+        std::unique_ptr<void, decltype(&CloseHandle)> event(CreateEventW(nullptr, TRUE, FALSE, nullptr), CloseHandle);
+
+        Load();   // results from previous run
+        Rescan(); // queue packages that changed while not watching
+        std::wcout << L"Watching " << m_folder << L" (" << m_results.size() << L" packages)\n";
+
+        std::vector<DWORD> buffer(64 * 1024 / sizeof(DWORD)); // DWORD-aligned notification buffer
+        const DWORD FILTER = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+        while (true) {
+            OVERLAPPED overlapped = {};
+            overlapped.hEvent = event.get();
+            ResetEvent(event.get());
+            if (!ReadDirectoryChangesW(dir.get(), buffer.data(), static_cast<DWORD>(buffer.size() * sizeof(DWORD)), TRUE, FILTER, nullptr, &overlapped, nullptr))
+                throw std::runtime_error("ReadDirectoryChangesW failed");
+
+            // analyze settled packages while waiting for new notifications
+            while (WaitForSingleObject(event.get(), POLL_INTERVAL_MS) == WAIT_TIMEOUT)
+                ProcessPending();
+
+            DWORD bytes = 0;
+            if (!GetOverlappedResult(dir.get(), &overlapped, &bytes, FALSE) || (bytes == 0)) {
+                Rescan(); // notification buffer overflow
+                continue;
+            }
+
+            const BYTE* ptr = reinterpret_cast<const BYTE*>(buffer.data());
+            while (true) {
+                auto* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(ptr);
+                OnChange(info->Action, m_folder + L'\\' + std::wstring(info->FileName, info->FileNameLength / sizeof(wchar_t)));
+
+                if (info->NextEntryOffset == 0)
+                    break;
+                ptr += info->NextEntryOffset;
+            }
+        }
+    }
+
+private:
+    void OnChange(DWORD action, const std::wstring& path) {
+        if ((action == FILE_ACTION_REMOVED) || (action == FILE_ACTION_RENAMED_OLD_NAME)) {
+            if (Remove(path))
+                Save();
+            return;
+        }
+
+        if (HasMsiExtension(path)) {
+            m_pending[path] = GetTickCount64();
+            return;
+        }
+
+        DWORD attribs = GetFileAttributesW(path.c_str());
+        if ((attribs != INVALID_FILE_ATTRIBUTES) && (attribs & FILE_ATTRIBUTE_DIRECTORY) && ((action == FILE_ACTION_ADDED) || (action == FILE_ACTION_RENAMED_NEW_NAME))) {
+            // folder moved into the watched tree
+            for (const std::wstring& msi_file : FindMsiFiles(path))
+                m_pending[msi_file] = GetTickCount64();
+        }
+    }
+
+    /** Analyze all pending packages that have settled. */
+    void ProcessPending() {
+        const ULONGLONG now = GetTickCount64();
+        bool changed = false;
+        for (auto it = m_pending.begin(); it != m_pending.end();) {
+            if (now - it->second < SETTLE_TIME_MS) {
+                ++it;
+                continue;
+            }
+
+            const std::wstring path = it->first;
+            if (!IsWriteComplete(path)) {
+                it->second = now; // still being written
+                ++it;
+                continue;
+            }
+            it = m_pending.erase(it);
+
+            uint64_t last_write = 0, size = 0;
+            if (!GetFileInfo(path, last_write, size)) {
+                changed |= Remove(path); // deleted in the meantime
+                continue;
+            }
+
+            auto existing = m_results.find(path);
+            if ((existing != m_results.end()) && (existing->second.LastWrite == last_write) && (existing->second.Size == size))
+                continue; // unchanged
+
+            PackageSummary summary = SummarizeMsiFile(path);
+            summary.LastWrite = last_write;
+            summary.Size = size;
+            m_results[path] = summary;
+            changed = true;
+
+            if (summary.Error.empty())
+                std::wcout << L"Analyzed " << path << L": " << summary.ProductName << L' ' << summary.ProductVersion << L" (" << summary.Files << L" files, " << summary.RegistryEntries << L" registry entries)\n";
+            else
+                std::wcout << L"ERROR: " << path << L": " << summary.Error << L'\n';
+        }
+
+        if (changed) {
+            Save();
+            PrintTotals();
+        }
+    }
+
+    /** Compare folder content against the result set and queue new or modified packages. */
+    void Rescan() {
+        std::map<std::wstring, bool> present;
+        for (const std::wstring& msi_file : FindMsiFiles(m_folder)) {
+            present[msi_file] = true;
+
+            uint64_t last_write = 0, size = 0;
+            if (!GetFileInfo(msi_file, last_write, size))
+                continue;
+
+            auto existing = m_results.find(msi_file);
+            if ((existing == m_results.end()) || (existing->second.LastWrite != last_write) || (existing->second.Size != size))
+                m_pending[msi_file] = 0; // already settled
+        }
+
+        bool changed = false;
+        for (auto it = m_results.begin(); it != m_results.end();) {
+            if (!present.count(it->first)) {
+                it = m_results.erase(it);
+                changed = true;
+            } else {
+                ++it;
+            }
+        }
+        if (changed)
+            Save();
+    }
+
+    /** Remove a package or all packages in a folder from the result set. */
+    bool Remove(const std::wstring& path) {
+        m_pending.erase(path);
+
+        bool removed = m_results.erase(path) > 0;
+        const std::wstring prefix = path + L'\\';
+        for (auto it = m_results.lower_bound(prefix); (it != m_results.end()) && (it->first.compare(0, prefix.size(), prefix) == 0);) {
+            it = m_results.erase(it);
+            removed = true;
+        }
+        for (auto it = m_pending.lower_bound(prefix); (it != m_pending.end()) && (it->first.compare(0, prefix.size(), prefix) == 0);)
+            it = m_pending.erase(it);
+
+        if (removed)
+            std::wcout << L"Removed " << path << L'\n';
+        return removed;
+    }
+
+    void PrintTotals() const {
+        size_t errors = 0;
+        for (auto& result : m_results)
+            errors += !result.second.Error.empty();
+
+        std::wcout << L"  " << m_results.size() << L" packages, " << errors << L" errors, " << m_pending.size() << L" pending\n";
+        std::wcout.flush(); // make progress visible also when output is redirected
+    }
+
+    /** Load result set from summary file. */
+    void Load() {
+        FILE* file = OpenFile(m_summary_file, L"r, ccs=UTF-8");
+        if (!file)
+            return; // first run
+
+        std::vector<wchar_t> line(64 * 1024);
+        fgetws(line.data(), static_cast<int>(line.size()), file); // skip header
+        while (fgetws(line.data(), static_cast<int>(line.size()), file)) {
+            std::vector<std::wstring> fields;
+            std::wstring str = line.data();
+            while (!str.empty() && ((str.back() == L'\n') || (str.back() == L'\r')))
+                str.pop_back();
+
+            size_t pos = 0;
+            while (true) {
+                size_t tab = str.find(L'\t', pos);
+                fields.push_back(str.substr(pos, tab - pos));
+                if (tab == std::wstring::npos)
+                    break;
+                pos = tab + 1;
+            }
+            if (fields.size() != 13)
+                continue; // malformed line
+
+            try {
+                PackageSummary summary;
+                summary.LastWrite = std::stoull(fields[1]);
+                summary.Size = std::stoull(fields[2]);
+                if (!fields[3].empty())
+                    summary.ProductCode = Guid::Parse(fields[3]);
+                summary.ProductName = fields[4];
+                summary.ProductVersion = fields[5];
+                summary.Manufacturer = fields[6];
+                summary.Features = std::stoul(fields[7]);
+                summary.Files = std::stoul(fields[8]);
+                summary.Components = std::stoul(fields[9]);
+                summary.RegistryEntries = std::stoul(fields[10]);
+                summary.CustomActions = std::stoul(fields[11]);
+                summary.Error = fields[12];
+                m_results[fields[0]] = summary;
+            } catch (const std::exception&) {
+                // malformed line
+            }
+        }
+        fclose(file);
+    }
+
+    /** Write result set to summary file. A temporary file is renamed so that readers never see a partial summary. */
+    void Save() const {
+        const std::wstring tmp_file = m_summary_file + L".tmp";
+        FILE* file = OpenFile(tmp_file, L"w, ccs=UTF-8");
+        if (!file)
+            throw std::runtime_error("Unable to write summary file");
+
+        fputws(L"Path\tLastWrite\tSize\tProductCode\tProductName\tProductVersion\tManufacturer\tFeatures\tFiles\tComponents\tRegistryEntries\tCustomActions\tError\n", file);
+        for (auto& result : m_results) {
+            const PackageSummary& s = result.second;
+            std::wstring line = Sanitize(result.first) + L'\t' + std::to_wstring(s.LastWrite) + L'\t' + std::to_wstring(s.Size) + L'\t'
+                + (s.ProductCode.IsNull() ? L"" : s.ProductCode.ToString()) + L'\t' + Sanitize(s.ProductName) + L'\t' + Sanitize(s.ProductVersion) + L'\t' + Sanitize(s.Manufacturer) + L'\t'
+                + std::to_wstring(s.Features) + L'\t' + std::to_wstring(s.Files) + L'\t' + std::to_wstring(s.Components) + L'\t'
+                + std::to_wstring(s.RegistryEntries) + L'\t' + std::to_wstring(s.CustomActions) + L'\t' + Sanitize(s.Error) + L'\n';
+            fputws(line.c_str(), file);
+        }
+        if (fclose(file) != 0)
+            throw std::runtime_error("Unable to write summary file");
+
+        ReplaceFile(tmp_file, m_summary_file);
+    }
+
+    /** Replace tab & newline characters that would break the summary file format. */
+    static std::wstring Sanitize(std::wstring str) {
+        for (wchar_t& c : str) {
+            if ((c == L'\t') || (c == L'\r') || (c == L'\n'))
+                c = L' ';
+        }
+        return str;
+    }
+
+    static bool GetFileInfo(const std::wstring& path, uint64_t& last_write, uint64_t& size) {
+        WIN32_FILE_ATTRIBUTE_DATA attribs = {};
+        if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &attribs))
+            return false;
+
+        last_write = (static_cast<uint64_t>(attribs.ftLastWriteTime.dwHighDateTime) << 32) | attribs.ftLastWriteTime.dwLowDateTime;
+        size = (static_cast<uint64_t>(attribs.nFileSizeHigh) << 32) | attribs.nFileSizeLow;
+        return true;
+    }
+
+    /** Check that no other process has the file open for writing. */
+    static bool IsWriteComplete(const std::wstring& path) {
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return GetLastError() != ERROR_SHARING_VIOLATION;
+
+        CloseHandle(file);
+        return true;
+    }
+
+    const std::wstring                     m_folder;
+    const std::wstring                     m_summary_file;
+    std::map<std::wstring, PackageSummary> m_results; ///< analyzed packages sorted by path
+    std::map<std::wstring, ULONGLONG>      m_pending; ///< changed packages with time of last change
+};
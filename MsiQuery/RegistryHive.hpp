@@ -0,0 +1,244 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+/** Read-only parser of offline registry hive files ("regf" format), like a SOFTWARE hive copied from a Windows image.
+    Operates on an in-memory buffer, which is typically a memory-mapped file. Keys and values are identified by their cell offsets.
+    Pending transaction logs (.LOG1/.LOG2) are not applied, so hives should be copied from a cleanly unmounted image.
+    REF: https://github.com/msuhanov/regf/blob/master/Windows%20registry%20file%20format%20specification.md */
+class RegistryHive {
+public:
+    RegistryHive(const uint8_t* data, size_t size) : m_data(data), m_size(size) {
+        if ((size < HBIN_START) || (memcmp(data, "regf", 4) != 0))
+            throw std::runtime_error("Not a registry hive file");
+
+        m_root = Read32(0x24);
+        if (Signature(m_root) != SIG_NK)
+            throw std::runtime_error("Invalid registry hive root key");
+    }
+
+    /** Root key of the hive. */
+    uint32_t Root() const {
+        return m_root;
+    }
+
+    /** Find subkey by backslash-separated path. Names are compared case-insensitively (ASCII only). Returns 0 if not found. */
+    uint32_t Subkey(uint32_t key, const std::wstring& path) const {
+        size_t start = 0;
+        while ((key != 0) && (start < path.size())) {
+            size_t end = path.find(L'\\', start);
+            if (end == path.npos)
+                end = path.size();
+
+            const std::wstring name = path.substr(start, end - start);
+            uint32_t match = 0;
+            ForEachSubkey(key, [&](uint32_t subkey) {
+                if ((match == 0) && EqualsNoCase(KeyName(subkey), name))
+                    match = subkey;
+            });
+            key = match;
+            start = end + 1;
+        }
+        return key;
+    }
+
+    /** Call visit(subkey) for all subkeys in hive order. */
+    template <class Visitor>
+    void ForEachSubkey(uint32_t key, Visitor visit) const {
+        if (Signature(key) != SIG_NK)
+            throw std::runtime_error("Invalid registry key cell");
+        if (Read32(Cell(key) + 0x14) == 0)
+            return; // no stable subkeys
+
+        uint32_t list = Read32(Cell(key) + 0x1C);
+        if (Signature(list) == SIG_RI) {
+            // index root refers to further subkey lists (never nested)
+            const size_t pos = Cell(list);
+            const uint16_t count = Read16(pos + 2);
+            for (uint16_t i = 0; i < count; ++i) {
+                uint32_t sub_list = Read32(pos + 4 + 4 * i);
+                if (Signature(sub_list) == SIG_RI)
+                    throw std::runtime_error("Nested registry index root");
+                ForEachListEntry(sub_list, visit);
+            }
+        } else {
+            ForEachListEntry(list, visit);
+        }
+    }
+
+    /** Call visit(value) for all values of a key. */
+    template <class Visitor>
+    void ForEachValue(uint32_t key, Visitor visit) const {
+        if (Signature(key) != SIG_NK)
+            throw std::runtime_error("Invalid registry key cell");
+
+        const uint32_t count = Read32(Cell(key) + 0x24);
+        if (count == 0)
+            return;
+        const size_t list = Cell(Read32(Cell(key) + 0x28));
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t value = Read32(list + 4 * i);
+            if (Signature(value) != SIG_VK)
+                throw std::runtime_error("Invalid registry value cell");
+            visit(value);
+        }
+    }
+
+    std::wstring KeyName(uint32_t key) const {
+        const size_t pos = Cell(key);
+        const bool compressed = (Read16(pos + 0x02) & 0x0020) != 0; // KEY_COMP_NAME
+        return ReadName(pos + 0x4C, Read16(pos + 0x48), compressed);
+    }
+
+    std::wstring ValueName(uint32_t value) const {
+        const size_t pos = Cell(value);
+        const bool compressed = (Read16(pos + 0x10) & 0x0001) != 0; // VALUE_COMP_NAME
+        return ReadName(pos + 0x14, Read16(pos + 0x02), compressed);
+    }
+
+    uint32_t ValueType(uint32_t value) const {
+        return Read32(Cell(value) + 0x0C);
+    }
+
+    /** Raw value data. Data larger than 16344 bytes is assembled from "db" big data segments. */
+    std::vector<uint8_t> ValueData(uint32_t value) const {
+        const size_t pos = Cell(value);
+        uint32_t size = Read32(pos + 0x04);
+        if (size & 0x80000000) {
+            // up to 4 bytes stored inline in the data offset field
+            size &= 0x7FFFFFFF;
+            if (size > 4)
+                throw std::runtime_error("Invalid registry inline value size");
+            Check(pos + 0x08, size);
+            return std::vector<uint8_t>(m_data + pos + 0x08, m_data + pos + 0x08 + size);
+        }
+
+        const uint32_t data = Read32(pos + 0x08);
+        if ((size > BIG_DATA_SEGMENT) && (Signature(data) == SIG_DB)) {
+            std::vector<uint8_t> result;
+            result.reserve(size);
+
+            const uint16_t count = Read16(Cell(data) + 2);
+            const size_t segments = Cell(Read32(Cell(data) + 4));
+            for (uint16_t i = 0; (i < count) && (result.size() < size); ++i) {
+                const size_t segment = Cell(Read32(segments + 4 * i));
+                const size_t len = std::min<size_t>(static_cast<size_t>(BIG_DATA_SEGMENT), size - result.size());
+                Check(segment, len);
+                result.insert(result.end(), m_data + segment, m_data + segment + len);
+            }
+            if (result.size() != size)
+                throw std::runtime_error("Truncated registry big data value");
+            return result;
+        }
+
+        const size_t cell = Cell(data);
+        Check(cell, size);
+        return std::vector<uint8_t>(m_data + cell, m_data + cell + size);
+    }
+
+    /** REG_SZ or REG_EXPAND_SZ value data without trailing null characters. */
+    std::wstring ValueString(uint32_t value) const {
+        const std::vector<uint8_t> data = ValueData(value);
+        std::wstring result;
+        result.reserve(data.size() / 2);
+        for (size_t i = 0; i + 1 < data.size(); i += 2)
+            result += static_cast<wchar_t>(data[i] | (data[i + 1] << 8));
+
+        while (!result.empty() && (result.back() == L'\0'))
+            result.pop_back();
+        return result;
+    }
+
+private:
+    static const size_t   HBIN_START = 0x1000; ///< cell offsets are relative to the first hive bin
+    static const uint32_t BIG_DATA_SEGMENT = 16344;
+    static const uint16_t SIG_NK = 0x6B6E; // "nk"
+    static const uint16_t SIG_VK = 0x6B76; // "vk"
+    static const uint16_t SIG_LF = 0x666C; // "lf"
+    static const uint16_t SIG_LH = 0x686C; // "lh"
+    static const uint16_t SIG_LI = 0x696C; // "li"
+    static const uint16_t SIG_RI = 0x6972; // "ri"
+    static const uint16_t SIG_DB = 0x6264; // "db"
+
+    template <class Visitor>
+    void ForEachListEntry(uint32_t list, Visitor& visit) const {
+        const size_t pos = Cell(list);
+        const uint16_t signature = Read16(pos);
+        const uint16_t count = Read16(pos + 2);
+
+        size_t stride = 0;
+        if ((signature == SIG_LF) || (signature == SIG_LH))
+            stride = 8; // offset + name hint/hash
+        else if (signature == SIG_LI)
+            stride = 4;
+        else
+            throw std::runtime_error("Invalid registry subkey list");
+
+        for (uint16_t i = 0; i < count; ++i) {
+            uint32_t subkey = Read32(pos + 4 + stride * i);
+            if (Signature(subkey) != SIG_NK)
+                throw std::runtime_error("Invalid registry key cell");
+            visit(subkey);
+        }
+    }
+
+    /** File position of the data of a cell, after the size field. */
+    size_t Cell(uint32_t offset) const {
+        const size_t pos = HBIN_START + static_cast<size_t>(offset) + 4;
+        Check(pos, 0);
+        return pos;
+    }
+
+    uint16_t Signature(uint32_t offset) const {
+        return Read16(Cell(offset));
+    }
+
+    std::wstring ReadName(size_t pos, uint16_t len, bool compressed) const {
+        Check(pos, len);
+        std::wstring name;
+        if (compressed) {
+            // Latin-1 characters
+            name.assign(m_data + pos, m_data + pos + len);
+        } else {
+            name.reserve(len / 2);
+            for (size_t i = 0; i + 1 < len; i += 2)
+                name += static_cast<wchar_t>(m_data[pos + i] | (m_data[pos + i + 1] << 8));
+        }
+        return name;
+    }
+
+    static bool EqualsNoCase(const std::wstring& a, const std::wstring& b) {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); ++i) {
+            wchar_t ca = ((a[i] >= L'a') && (a[i] <= L'z')) ? static_cast<wchar_t>(a[i] - 32) : a[i];
+            wchar_t cb = ((b[i] >= L'a') && (b[i] <= L'z')) ? static_cast<wchar_t>(b[i] - 32) : b[i];
+            if (ca != cb)
+                return false;
+        }
+        return true;
+    }
+
+    void Check(size_t pos, size_t len) const {
+        if ((pos > m_size) || (len > m_size - pos))
+            throw std::runtime_error("Registry hive read out of bounds");
+    }
+
+    uint16_t Read16(size_t pos) const {
+        Check(pos, 2);
+        return static_cast<uint16_t>(m_data[pos] | (m_data[pos + 1] << 8));
+    }
+
+    uint32_t Read32(size_t pos) const {
+        return Read16(pos) | (static_cast<uint32_t>(Read16(pos + 2)) << 16);
+    }
+
+    const uint8_t* m_data = nullptr;
+    size_t         m_size = 0;
+    uint32_t       m_root = 0;
+};
@@ -0,0 +1,398 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <io.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define TEXT_USE_SSE2
+#endif
+
+
+/** Code pages that are converted without going through the OS.
+    REF: https://learn.microsoft.com/en-us/windows/win32/intl/code-page-identifiers */
+enum CodePageId : unsigned int {
+    CODEPAGE_NEUTRAL = 0,    ///< MSI "neutral" database, interpreted as the system ANSI code page (CP_ACP)
+    CODEPAGE_1252    = 1252, ///< Western European (Windows)
+    CODEPAGE_ASCII   = 20127,
+    CODEPAGE_LATIN1  = 28591, ///< ISO 8859-1
+    CODEPAGE_UTF8    = 65001,
+};
+
+
+/** Length of the leading run of 7bit ASCII characters. */
+inline size_t AsciiPrefixLength (const char* data, size_t size) {
+    size_t i = 0;
+#ifdef TEXT_USE_SSE2
+    for (; i + 16 <= size; i += 16) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+        if (mask) {
+            for (; !(mask & 1); mask >>= 1)
+                ++i;
+            return i;
+        }
+    }
+#endif
+    while ((i < size) && !(data[i] & 0x80))
+        ++i;
+    return i;
+}
+
+
+/** Append a Unicode code point as UTF-8. */
+inline char* EncodeUtf8 (char* out, uint32_t cp) {
+    if (cp < 0x80) {
+        *out++ = static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        *out++ = static_cast<char>(0xC0 | (cp >> 6));
+        *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        *out++ = static_cast<char>(0xE0 | (cp >> 12));
+        *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        *out++ = static_cast<char>(0xF0 | (cp >> 18));
+        *out++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    return out;
+}
+
+/** Append a Unicode code point as UTF-8. Surrogates and values above U+10FFFF are replaced by U+FFFD. */
+inline void AppendUtf8 (std::string& out, uint32_t cp) {
+    if ((cp > 0x10FFFF) || ((cp >= 0xD800) && (cp <= 0xDFFF)))
+        cp = 0xFFFD;
+    char buffer[4];
+    out.append(buffer, EncodeUtf8(buffer, cp));
+}
+
+/** Append a Unicode code point as UTF-16 (Windows) or UTF-32 (other platforms). */
+inline void AppendWide (std::wstring& out, uint32_t cp) {
+    if ((sizeof(wchar_t) == 2) && (cp >= 0x10000)) {
+        cp -= 0x10000;
+        out += static_cast<wchar_t>(0xD800 | (cp >> 10));
+        out += static_cast<wchar_t>(0xDC00 | (cp & 0x3FF));
+    } else {
+        out += static_cast<wchar_t>(cp);
+    }
+}
+
+
+/** Map a single byte from a natively supported single-byte code page to Unicode. */
+inline uint32_t SingleByteToUnicode (unsigned char c, unsigned int codepage) {
+    // Windows-1252 differs from ISO 8859-1 in the 0x80-0x9F range (undefined positions map to C1 controls like MultiByteToWideChar)
+    static const uint16_t CP1252_HIGH[32] = {
+        0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+        0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178};
+
+    if (c < 0x80)
+        return c;
+    if (codepage == CODEPAGE_ASCII)
+        return 0xFFFD;
+    if ((codepage != CODEPAGE_LATIN1) && (c < 0xA0))
+        return CP1252_HIGH[c - 0x80];
+    return c;
+}
+
+/** Check if a code page is converted without going through the OS. */
+inline bool IsNativeCodePage (unsigned int codepage) {
+#ifdef _WIN32
+    // neutral databases use the system ANSI code page
+    return (codepage == CODEPAGE_1252) || (codepage == CODEPAGE_ASCII) || (codepage == CODEPAGE_LATIN1) || (codepage == CODEPAGE_UTF8);
+#else
+    // neutral databases are treated as Windows-1252 when there's no system ANSI code page
+    return (codepage == CODEPAGE_NEUTRAL) || (codepage == CODEPAGE_1252) || (codepage == CODEPAGE_ASCII) || (codepage == CODEPAGE_LATIN1) || (codepage == CODEPAGE_UTF8);
+#endif
+}
+
+
+/** Decode next UTF-8 sequence. Invalid or truncated sequences are replaced with U+FFFD. */
+inline uint32_t DecodeUtf8 (const unsigned char*& pos, const unsigned char* end) {
+    unsigned char c = *pos++;
+    if (c < 0x80)
+        return c;
+
+    int extra = 0;
+    uint32_t cp = 0;
+    uint32_t min_cp = 0;
+    if ((c & 0xE0) == 0xC0) {
+        extra = 1; cp = c & 0x1F; min_cp = 0x80;
+    } else if ((c & 0xF0) == 0xE0) {
+        extra = 2; cp = c & 0x0F; min_cp = 0x800;
+    } else if ((c & 0xF8) == 0xF0) {
+        extra = 3; cp = c & 0x07; min_cp = 0x10000;
+    } else {
+        return 0xFFFD; // stray continuation byte or invalid lead byte
+    }
+
+    for (int i = 0; i < extra; ++i) {
+        if ((pos == end) || ((*pos & 0xC0) != 0x80))
+            return 0xFFFD;
+        cp = (cp << 6) | (*pos++ & 0x3F);
+    }
+    if ((cp < min_cp) || (cp > 0x10FFFF) || ((cp >= 0xD800) && (cp <= 0xDFFF)))
+        return 0xFFFD; // overlong encoding or invalid code point
+    return cp;
+}
+
+
+/** Convert code page encoded text to wide characters. */
+inline std::wstring ToWide (const char* data, size_t size, unsigned int codepage) {
+    std::wstring result;
+    if (size == 0)
+        return result;
+
+#ifdef _WIN32
+    if (!IsNativeCodePage(codepage)) {
+        int len = MultiByteToWideChar(codepage, 0, data, static_cast<int>(size), nullptr, 0);
+        result.resize(len);
+        MultiByteToWideChar(codepage, 0, data, static_cast<int>(size), const_cast<wchar_t*>(result.data()), len);
+        return result;
+    }
+#endif
+
+    result.reserve(size);
+    const unsigned char* pos = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char* end = pos + size;
+    while (pos < end) {
+        size_t ascii = AsciiPrefixLength(reinterpret_cast<const char*>(pos), end - pos);
+        result.append(pos, pos + ascii);
+        pos += ascii;
+        if (pos == end)
+            break;
+
+        if (codepage == CODEPAGE_UTF8)
+            AppendWide(result, DecodeUtf8(pos, end));
+        else if (IsNativeCodePage(codepage))
+            AppendWide(result, SingleByteToUnicode(*pos++, codepage));
+        else {
+            ++pos;
+            AppendWide(result, 0xFFFD); // code page not available on this platform
+        }
+    }
+    return result;
+}
+
+
+/** Append wide-character text as UTF-8. Unless "final" is set, a trailing unpaired high surrogate is left unconverted.
+    Returns the number of characters consumed. */
+inline size_t AppendUtf8 (std::string& out, const wchar_t* data, size_t size, bool final = true) {
+    const size_t start = out.size();
+    out.resize(start + ((sizeof(wchar_t) == 2) ? 3 : 4) * size); // worst case
+    char* dst = &out[start];
+
+    size_t i = 0;
+    while (i < size) {
+#ifdef TEXT_USE_SSE2
+        // convert ASCII runs 16 bytes at a time
+        const size_t LANES = 16 / sizeof(wchar_t);
+        while (i + LANES <= size) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i high = (sizeof(wchar_t) == 2) ? _mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xFF80))) : _mm_and_si128(v, _mm_set1_epi32(static_cast<int>(0xFFFFFF80)));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(high, _mm_setzero_si128())) != 0xFFFF)
+                break;
+
+            if (sizeof(wchar_t) == 2) {
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(v, v));
+            } else {
+                __m128i narrow = _mm_packus_epi16(_mm_packs_epi32(v, v), v);
+                int32_t chars = _mm_cvtsi128_si32(narrow);
+                memcpy(dst, &chars, 4);
+            }
+            dst += LANES;
+            i += LANES;
+        }
+        if (i == size)
+            break;
+#endif
+        uint32_t cp = static_cast<uint32_t>(data[i]);
+        if (sizeof(wchar_t) == 2) {
+            cp &= 0xFFFF;
+            if ((cp >= 0xD800) && (cp <= 0xDBFF)) {
+                if (i + 1 == size) {
+                    if (!final)
+                        break; // wait for the low surrogate
+                    cp = 0xFFFD;
+                } else if ((static_cast<uint32_t>(data[i + 1]) >= 0xDC00) && (static_cast<uint32_t>(data[i + 1]) <= 0xDFFF)) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (static_cast<uint32_t>(data[i + 1]) - 0xDC00);
+                    ++i;
+                } else {
+                    cp = 0xFFFD;
+                }
+            } else if ((cp >= 0xDC00) && (cp <= 0xDFFF)) {
+                cp = 0xFFFD; // unpaired low surrogate
+            }
+        } else if ((cp > 0x10FFFF) || ((cp >= 0xD800) && (cp <= 0xDFFF))) {
+            cp = 0xFFFD;
+        }
+        dst = EncodeUtf8(dst, cp);
+        ++i;
+    }
+
+    out.resize(dst - out.data());
+    return i;
+}
+
+/** Append code page encoded text as UTF-8. ASCII runs and UTF-8 input are copied as-is. */
+inline void AppendUtf8 (std::string& out, const char* data, size_t size, unsigned int codepage) {
+    if (codepage == CODEPAGE_UTF8) {
+        out.append(data, size);
+        return;
+    }
+    if (!IsNativeCodePage(codepage)) {
+        std::wstring wide = ToWide(data, size, codepage);
+        AppendUtf8(out, wide.data(), wide.size());
+        return;
+    }
+
+    const char* end = data + size;
+    while (data < end) {
+        size_t ascii = AsciiPrefixLength(data, end - data);
+        out.append(data, ascii);
+        data += ascii;
+        if (data == end)
+            break;
+
+        char buffer[4];
+        out.append(buffer, EncodeUtf8(buffer, SingleByteToUnicode(static_cast<unsigned char>(*data++), codepage)));
+    }
+}
+
+inline std::string ToUtf8 (const std::wstring& str) {
+    std::string result;
+    AppendUtf8(result, str.data(), str.size());
+    return result;
+}
+
+
+/** Converts system code page string, like exception messages, to unicode */
+inline std::wstring ToUnicode(const std::string& s_str) {
+    return ToWide(s_str.data(), s_str.size(), CODEPAGE_NEUTRAL);
+}
+
+/** Converts UTF-8 string to unicode */
+inline std::wstring Utf8ToUnicode(const std::string& u8_str) {
+    return ToWide(u8_str.data(), u8_str.size(), CODEPAGE_UTF8);
+}
+
+
+/** Non-owning view of code page encoded text, like a string pool entry.
+    Conversion is deferred until the text is actually needed, so that strings that are never printed are never converted. */
+class EncodedString {
+public:
+    EncodedString() = default;
+
+    EncodedString(const char* data, size_t size, unsigned int codepage) : m_data(data), m_size(size), m_codepage(codepage) {
+    }
+
+    bool empty() const {
+        return m_size == 0;
+    }
+
+    std::wstring Wide() const {
+        return ToWide(m_data, m_size, m_codepage);
+    }
+
+    void AppendUtf8(std::string& out) const {
+        ::AppendUtf8(out, m_data, m_size, m_codepage);
+    }
+
+private:
+    const char*  m_data = nullptr;
+    size_t       m_size = 0;
+    unsigned int m_codepage = CODEPAGE_NEUTRAL;
+};
+
+
+/** Wide-character stream buffer that replaces _setmode(_O_U16TEXT) for std::wcout.
+    Console output is written directly as UTF-16 through WriteConsoleW. Redirected output is converted to UTF-8 in bulk.
+    The buffer installs itself on construction and restores the previous buffer on destruction. */
+class Utf8OutputBuf : public std::wstreambuf {
+public:
+    Utf8OutputBuf(std::wostream& stream, FILE* file) : m_stream(stream), m_file(file) {
+#ifdef _WIN32
+        HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file)));
+        DWORD mode = 0;
+        if (GetConsoleMode(handle, &mode))
+            m_console = handle;
+#endif
+        setp(m_buffer, m_buffer + BUFFER_SIZE);
+        m_prev = m_stream.rdbuf(this);
+        if (IsConsole())
+            m_stream.setf(std::ios::unitbuf); // interactive output
+    }
+
+    ~Utf8OutputBuf() override {
+        sync();
+        m_stream.rdbuf(m_prev);
+    }
+
+    Utf8OutputBuf(const Utf8OutputBuf&) = delete;
+    Utf8OutputBuf& operator = (const Utf8OutputBuf&) = delete;
+
+    bool IsConsole() const {
+#ifdef _WIN32
+        return m_console != nullptr;
+#else
+        return false;
+#endif
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        Flush(false);
+        if (ch != traits_type::eof()) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override {
+        Flush(true);
+        return fflush(m_file) == 0 ? 0 : -1;
+    }
+
+private:
+    void Flush(bool final) {
+        const size_t count = pptr() - pbase();
+        size_t consumed = count;
+#ifdef _WIN32
+        if (m_console) {
+            DWORD written = 0;
+            WriteConsoleW(m_console, pbase(), static_cast<DWORD>(count), &written, nullptr);
+        } else
+#endif
+        {
+            m_utf8.clear();
+            consumed = AppendUtf8(m_utf8, pbase(), count, final);
+            fwrite(m_utf8.data(), 1, m_utf8.size(), m_file);
+        }
+
+        // keep unconverted high surrogate for the next flush
+        const size_t remaining = count - consumed;
+        memmove(m_buffer, m_buffer + consumed, remaining * sizeof(wchar_t));
+        setp(m_buffer, m_buffer + BUFFER_SIZE);
+        pbump(static_cast<int>(remaining));
+    }
+
+    static const size_t BUFFER_SIZE = 16 * 1024;
+
+    std::wostream&   m_stream;
+    std::wstreambuf* m_prev = nullptr;
+    FILE*            m_file = nullptr;
+#ifdef _WIN32
+    HANDLE           m_console = nullptr;
+#endif
+    wchar_t          m_buffer[BUFFER_SIZE];
+    std::string      m_utf8; ///< conversion buffer
+};
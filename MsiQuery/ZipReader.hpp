@@ -0,0 +1,429 @@
+#pragma once
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+/** Decoder for raw DEFLATE streams (no zlib/gzip header).
+    Straightforward port of the "puff" reference decoder, which is sufficient for small archive members like package manifests.
+    REF: https://www.rfc-editor.org/rfc/rfc1951 */
+class Inflater {
+public:
+    static std::vector<uint8_t> Inflate(const uint8_t* src, size_t src_len, size_t expected_size) {
+        // DEFLATE cannot expand more than 1032:1, so larger sizes in the archive directory are bogus
+        if (expected_size / MAX_RATIO > src_len)
+            throw std::runtime_error("Deflate size exceeds maximum compression ratio");
+
+        Inflater state(src, src_len, expected_size);
+        state.m_out.reserve(expected_size);
+
+        bool last = false;
+        while (!last) {
+            last = state.Bits(1) != 0;
+            switch (state.Bits(2)) {
+            case 0: state.Stored(); break;
+            case 1: state.Fixed(); break;
+            case 2: state.Dynamic(); break;
+            default: throw std::runtime_error("Invalid deflate block type");
+            }
+        }
+
+        if (state.m_out.size() != expected_size)
+            throw std::runtime_error("Deflate size mismatch");
+        return std::move(state.m_out);
+    }
+
+private:
+    static const int MAXBITS = 15;    ///< maximum bits in a code
+    static const int MAXLCODES = 286; ///< maximum number of literal/length codes
+    static const int MAXDCODES = 30;  ///< maximum number of distance codes
+    static const int FIXLCODES = 288; ///< number of fixed literal/length codes
+    static const size_t MAX_RATIO = 1032; ///< maximum DEFLATE expansion ratio (258 byte match per 2 bits)
+
+    struct Huffman {
+        uint16_t count[MAXBITS + 1]; ///< number of symbols of each length
+        uint16_t symbol[FIXLCODES];  ///< canonically ordered symbols
+    };
+
+    Inflater(const uint8_t* src, size_t src_len, size_t limit) : m_src(src), m_len(src_len), m_limit(limit) {
+    }
+
+    /** Fail before output grows beyond the expected size, so that crafted streams cannot exhaust memory. */
+    void Reserve(size_t len) const {
+        if (len > m_limit - m_out.size())
+            throw std::runtime_error("Deflate output exceeds expected size");
+    }
+
+    uint32_t Bits(int need) {
+        uint32_t val = m_bitbuf;
+        while (m_bitcnt < need) {
+            if (m_pos == m_len)
+                throw std::runtime_error("Deflate stream truncated");
+            val |= static_cast<uint32_t>(m_src[m_pos++]) << m_bitcnt;
+            m_bitcnt += 8;
+        }
+
+        m_bitbuf = val >> need;
+        m_bitcnt -= need;
+        return val & ((1u << need) - 1);
+    }
+
+    void Stored() {
+        // discard leftover bits from current byte
+        m_bitbuf = 0;
+        m_bitcnt = 0;
+
+        if (m_pos + 4 > m_len)
+            throw std::runtime_error("Deflate stream truncated");
+        unsigned int len = m_src[m_pos] | (m_src[m_pos + 1] << 8);
+        unsigned int nlen = m_src[m_pos + 2] | (m_src[m_pos + 3] << 8);
+        m_pos += 4;
+        if (len != (~nlen & 0xFFFF))
+            throw std::runtime_error("Deflate stored block length mismatch");
+        if (m_pos + len > m_len)
+            throw std::runtime_error("Deflate stream truncated");
+
+        Reserve(len);
+        m_out.insert(m_out.end(), m_src + m_pos, m_src + m_pos + len);
+        m_pos += len;
+    }
+
+    int Decode(const Huffman& h) {
+        int code = 0;  // bits being decoded
+        int first = 0; // first code of length len
+        int index = 0; // index of first code of length len in symbol table
+        for (int len = 1; len <= MAXBITS; ++len) {
+            code |= Bits(1);
+            int count = h.count[len];
+            if (code - count < first)
+                return h.symbol[index + (code - first)];
+            index += count;
+            first += count;
+            first <<= 1;
+            code <<= 1;
+        }
+        throw std::runtime_error("Invalid deflate code");
+    }
+
+    /** Build canonical Huffman table from code lengths. Returns 0 for a complete code, negative for over-subscribed and positive for incomplete codes. */
+    static int Construct(Huffman& h, const uint16_t* length, int n) {
+        memset(h.count, 0, sizeof(h.count));
+        for (int symbol = 0; symbol < n; ++symbol)
+            h.count[length[symbol]]++;
+        if (h.count[0] == n)
+            return 0; // no codes
+
+        int left = 1;
+        for (int len = 1; len <= MAXBITS; ++len) {
+            left <<= 1;
+            left -= h.count[len];
+            if (left < 0)
+                return left; // over-subscribed
+        }
+
+        uint16_t offs[MAXBITS + 1] = {};
+        for (int len = 1; len < MAXBITS; ++len)
+            offs[len + 1] = offs[len] + h.count[len];
+        for (int symbol = 0; symbol < n; ++symbol) {
+            if (length[symbol] != 0)
+                h.symbol[offs[length[symbol]]++] = static_cast<uint16_t>(symbol);
+        }
+        return left;
+    }
+
+    void Codes(const Huffman& lencode, const Huffman& distcode) {
+        static const uint16_t LENS[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static const uint16_t LEXT[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        static const uint16_t DISTS[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+        static const uint16_t DEXT[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+        while (true) {
+            int symbol = Decode(lencode);
+            if (symbol < 256) {
+                Reserve(1);
+                m_out.push_back(static_cast<uint8_t>(symbol)); // literal
+            } else if (symbol == 256) {
+                return; // end of block
+            } else {
+                symbol -= 257;
+                if (symbol >= 29)
+                    throw std::runtime_error("Invalid deflate length symbol");
+                size_t len = LENS[symbol] + Bits(LEXT[symbol]);
+
+                symbol = Decode(distcode);
+                if (symbol >= 30)
+                    throw std::runtime_error("Invalid deflate distance symbol");
+                size_t dist = DISTS[symbol] + Bits(DEXT[symbol]);
+                if (dist > m_out.size())
+                    throw std::runtime_error("Deflate distance too far back");
+
+                // copy byte-by-byte, since source and destination might overlap
+                Reserve(len);
+                size_t from = m_out.size() - dist;
+                for (size_t i = 0; i < len; ++i)
+                    m_out.push_back(m_out[from + i]);
+            }
+        }
+    }
+
+    void Fixed() {
+        static Huffman lencode, distcode;
+        static bool initialized = [&]() {
+            uint16_t lengths[FIXLCODES];
+            int symbol = 0;
+            for (; symbol < 144; ++symbol)
+                lengths[symbol] = 8;
+            for (; symbol < 256; ++symbol)
+                lengths[symbol] = 9;
+            for (; symbol < 280; ++symbol)
+                lengths[symbol] = 7;
+            for (; symbol < FIXLCODES; ++symbol)
+                lengths[symbol] = 8;
+            Construct(lencode, lengths, FIXLCODES);
+
+            for (symbol = 0; symbol < MAXDCODES; ++symbol)
+                lengths[symbol] = 5;
+            Construct(distcode, lengths, MAXDCODES);
+            return true;
+        }();
+        (void)initialized;
+
+        Codes(lencode, distcode);
+    }
+
+    void Dynamic() {
+        static const uint8_t ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+        int nlen = Bits(5) + 257;
+        int ndist = Bits(5) + 1;
+        int ncode = Bits(4) + 4;
+        if ((nlen > MAXLCODES) || (ndist > MAXDCODES))
+            throw std::runtime_error("Invalid deflate code counts");
+
+        uint16_t lengths[MAXLCODES + MAXDCODES] = {};
+        for (int index = 0; index < ncode; ++index)
+            lengths[ORDER[index]] = static_cast<uint16_t>(Bits(3));
+
+        Huffman lencode = {}, distcode = {};
+        if (Construct(lencode, lengths, 19) != 0)
+            throw std::runtime_error("Invalid deflate code lengths code");
+
+        int index = 0;
+        while (index < nlen + ndist) {
+            int symbol = Decode(lencode);
+            if (symbol < 16) {
+                lengths[index++] = static_cast<uint16_t>(symbol);
+                continue;
+            }
+
+            uint16_t len = 0; // length to repeat
+            if (symbol == 16) {
+                if (index == 0)
+                    throw std::runtime_error("Invalid deflate repeat");
+                len = lengths[index - 1];
+                symbol = 3 + Bits(2);
+            } else if (symbol == 17) {
+                symbol = 3 + Bits(3);
+            } else {
+                symbol = 11 + Bits(7);
+            }
+            if (index + symbol > nlen + ndist)
+                throw std::runtime_error("Invalid deflate repeat");
+            while (symbol--)
+                lengths[index++] = len;
+        }
+        if (lengths[256] == 0)
+            throw std::runtime_error("Missing deflate end-of-block code");
+
+        int err = Construct(lencode, lengths, nlen);
+        if ((err < 0) || ((err > 0) && (nlen != lencode.count[0] + lencode.count[1])))
+            throw std::runtime_error("Invalid deflate literal/length code");
+        err = Construct(distcode, lengths + nlen, ndist);
+        if ((err < 0) || ((err > 0) && (ndist != distcode.count[0] + distcode.count[1])))
+            throw std::runtime_error("Invalid deflate distance code");
+
+        Codes(lencode, distcode);
+    }
+
+    const uint8_t*       m_src = nullptr;
+    size_t               m_len = 0;
+    size_t               m_limit = 0; ///< expected output size
+    size_t               m_pos = 0;
+    uint32_t             m_bitbuf = 0;
+    int                  m_bitcnt = 0;
+    std::vector<uint8_t> m_out;
+};
+
+
+/** Read-only ZIP archive reader that only parses the central directory and extracts individual members on demand.
+    Operates on an in-memory buffer, which is typically a memory-mapped file or a stored member of an outer archive.
+    REF: https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT */
+class ZipArchive {
+public:
+    struct Entry {
+        std::string Name;
+        uint16_t    Method = 0;           ///< 0=stored, 8=deflate
+        uint64_t    CompressedSize = 0;
+        uint64_t    UncompressedSize = 0;
+        uint64_t    LocalHeaderOffset = 0;
+    };
+
+    ZipArchive(const uint8_t* data, size_t size) : m_data(data), m_size(size) {
+        static const size_t EOCD_SIZE = 22;
+        if (size < EOCD_SIZE)
+            throw std::runtime_error("Not a ZIP archive");
+
+        // end of central directory record is located within the last 64kB (max comment length)
+        size_t eocd = std::string::npos;
+        size_t min_pos = (size > EOCD_SIZE + 0xFFFF) ? size - EOCD_SIZE - 0xFFFF : 0;
+        for (size_t pos = size - EOCD_SIZE + 1; pos-- > min_pos;) {
+            if (Read32(pos) == 0x06054b50) {
+                eocd = pos;
+                break;
+            }
+        }
+        if (eocd == std::string::npos)
+            throw std::runtime_error("ZIP end of central directory not found");
+
+        uint64_t entry_count = Read16(eocd + 10);
+        uint64_t cd_size = Read32(eocd + 12);
+        uint64_t cd_offset = Read32(eocd + 16);
+
+        // ZIP64 end of central directory locator precedes the EOCD record
+        if ((eocd >= 20) && (Read32(eocd - 20) == 0x07064b50)) {
+            uint64_t zip64_eocd = Read64(eocd - 20 + 8);
+            if ((zip64_eocd > size - 56) || (Read32(static_cast<size_t>(zip64_eocd)) != 0x06064b50))
+                throw std::runtime_error("Invalid ZIP64 end of central directory");
+            entry_count = Read64(static_cast<size_t>(zip64_eocd) + 32);
+            cd_size = Read64(static_cast<size_t>(zip64_eocd) + 40);
+            cd_offset = Read64(static_cast<size_t>(zip64_eocd) + 48);
+        }
+        if ((cd_offset > size) || (cd_size > size - cd_offset))
+            throw std::runtime_error("Invalid ZIP central directory");
+
+        size_t pos = static_cast<size_t>(cd_offset);
+        const size_t end = static_cast<size_t>(cd_offset + cd_size);
+        for (uint64_t i = 0; i < entry_count; ++i) {
+            if ((pos + 46 > end) || (Read32(pos) != 0x02014b50))
+                throw std::runtime_error("Invalid ZIP central directory entry");
+
+            Entry entry;
+            entry.Method = Read16(pos + 10);
+            entry.CompressedSize = Read32(pos + 20);
+            entry.UncompressedSize = Read32(pos + 24);
+            uint16_t name_len = Read16(pos + 28);
+            uint16_t extra_len = Read16(pos + 30);
+            uint16_t comment_len = Read16(pos + 32);
+            entry.LocalHeaderOffset = Read32(pos + 42);
+            if (pos + 46 + name_len + extra_len + comment_len > end)
+                throw std::runtime_error("Invalid ZIP central directory entry");
+
+            entry.Name.assign(reinterpret_cast<const char*>(m_data + pos + 46), name_len);
+            ParseZip64Extra(entry, pos + 46 + name_len, extra_len);
+
+            m_entries.push_back(entry);
+            pos += 46 + name_len + extra_len + comment_len;
+        }
+    }
+
+    const std::vector<Entry>& Entries() const {
+        return m_entries;
+    }
+
+    /** Case-insensitive lookup of archive member. Returns nullptr if not found. */
+    const Entry* Find(const std::string& name) const {
+        for (const Entry& entry : m_entries) {
+            if (entry.Name.size() != name.size())
+                continue;
+
+            bool match = true;
+            for (size_t i = 0; match && (i < name.size()); ++i)
+                match = tolower(static_cast<unsigned char>(entry.Name[i])) == tolower(static_cast<unsigned char>(name[i]));
+            if (match)
+                return &entry;
+        }
+        return nullptr;
+    }
+
+    /** Get pointer to the member data without copying. Only possible for stored (uncompressed) members. */
+    const uint8_t* StoredData(const Entry& entry) const {
+        if (entry.Method != 0)
+            return nullptr;
+        return m_data + DataOffset(entry);
+    }
+
+    /** Extract and decompress an archive member. */
+    std::vector<uint8_t> Extract(const Entry& entry) const {
+        const uint8_t* data = m_data + DataOffset(entry);
+        if (entry.Method == 0)
+            return std::vector<uint8_t>(data, data + entry.UncompressedSize);
+        if (entry.Method == 8)
+            return Inflater::Inflate(data, static_cast<size_t>(entry.CompressedSize), static_cast<size_t>(entry.UncompressedSize));
+
+        throw std::runtime_error("Unsupported ZIP compression method");
+    }
+
+private:
+    /** Offset of member data. Validated against the archive size. */
+    size_t DataOffset(const Entry& entry) const {
+        if ((entry.LocalHeaderOffset > m_size - 30) || (Read32(static_cast<size_t>(entry.LocalHeaderOffset)) != 0x04034b50))
+            throw std::runtime_error("Invalid ZIP local header");
+
+        size_t pos = static_cast<size_t>(entry.LocalHeaderOffset);
+        uint64_t offset = pos + 30 + Read16(pos + 26) + Read16(pos + 28); // skip name & extra field
+        uint64_t stored_size = (entry.Method == 0) ? entry.UncompressedSize : entry.CompressedSize;
+        if ((offset > m_size) || (stored_size > m_size - offset))
+            throw std::runtime_error("ZIP member out of bounds");
+
+        return static_cast<size_t>(offset);
+    }
+
+    /** Replace 0xFFFFFFFF placeholders with values from the ZIP64 extended information extra field. */
+    void ParseZip64Extra(Entry& entry, size_t pos, size_t len) const {
+        const size_t end = pos + len;
+        while (pos + 4 <= end) {
+            uint16_t id = Read16(pos);
+            uint16_t size = Read16(pos + 2);
+            pos += 4;
+            if (pos + size > end)
+                return;
+
+            if (id == 0x0001) {
+                size_t field = pos;
+                if ((entry.UncompressedSize == 0xFFFFFFFF) && (field + 8 <= pos + size)) {
+                    entry.UncompressedSize = Read64(field);
+                    field += 8;
+                }
+                if ((entry.CompressedSize == 0xFFFFFFFF) && (field + 8 <= pos + size)) {
+                    entry.CompressedSize = Read64(field);
+                    field += 8;
+                }
+                if ((entry.LocalHeaderOffset == 0xFFFFFFFF) && (field + 8 <= pos + size))
+                    entry.LocalHeaderOffset = Read64(field);
+                return;
+            }
+            pos += size;
+        }
+    }
+
+    uint16_t Read16(size_t pos) const {
+        if (pos + 2 > m_size)
+            throw std::runtime_error("ZIP read out of bounds");
+        return static_cast<uint16_t>(m_data[pos] | (m_data[pos + 1] << 8));
+    }
+
+    uint32_t Read32(size_t pos) const {
+        return Read16(pos) | (static_cast<uint32_t>(Read16(pos + 2)) << 16);
+    }
+
+    uint64_t Read64(size_t pos) const {
+        return Read32(pos) | (static_cast<uint64_t>(Read32(pos + 4)) << 32);
+    }
+
+    const uint8_t*     m_data = nullptr;
+    size_t             m_size = 0;
+    std::vector<Entry> m_entries;
+};